@@ -0,0 +1,313 @@
+/**************************************************************************
+ *  @file     mifare.c
+ *  @license  BSD
+ *
+ *  MIFARE Classic card geometry: sector <-> block mapping for
+ *  Mini/1K/2K/4K cards, sector trailer access conditions and value
+ *  block operations.
+ **************************************************************************/
+
+#include <string.h>
+#include "pn532.h"
+#include "mifare.h"
+
+// Keys allowed to read data blocks, indexed by C1C2C3
+static const uint8_t DATA_READ[] = {
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,  // 000 transport configuration
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,  // 001 value block
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,  // 010 read only
+    MIFARE_ACCESS_KEY_B,                        // 011
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,  // 100
+    MIFARE_ACCESS_KEY_B,                        // 101
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,  // 110 value block
+    0                                           // 111 never
+};
+
+// Keys allowed to read access bits of the sector trailer, indexed by C1C2C3
+static const uint8_t TRAILER_READ[] = {
+    MIFARE_ACCESS_KEY_A,
+    MIFARE_ACCESS_KEY_A,
+    MIFARE_ACCESS_KEY_A,
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B,
+    MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B
+};
+
+/**
+  * @brief: Number of sectors of MIFARE Classic card.
+  * @param card_type: PN532_CARD_* value.
+  * @retval: 0 if card is not a MIFARE Classic.
+  */
+uint8_t Mifare_SectorCount(uint8_t card_type) {
+    switch (card_type) {
+        case PN532_CARD_MIFARE_MINI:    return 5;
+        case PN532_CARD_MIFARE_1K:      return 16;
+        case PN532_CARD_MIFARE_2K:      return 32;
+        case PN532_CARD_MIFARE_4K:      return 40;
+        default:                        return 0;
+    }
+}
+
+/**
+  * @brief: Number of blocks of MIFARE Classic card.
+  * @param card_type: PN532_CARD_* value.
+  * @retval: 0 if card is not a MIFARE Classic.
+  */
+uint16_t Mifare_BlockCount(uint8_t card_type) {
+    uint8_t sectors = Mifare_SectorCount(card_type);
+    if (sectors == 0) {
+        return 0;
+    }
+    return Mifare_SectorTrailer(sectors - 1) + 1;
+}
+
+/**
+  * @brief: Sector holding the block.
+  */
+uint8_t Mifare_BlockToSector(uint16_t block_number) {
+    uint16_t small_blocks = MIFARE_SMALL_SECTORS * MIFARE_SMALL_SECTOR_BLOCKS;
+    if (block_number < small_blocks) {
+        return block_number / MIFARE_SMALL_SECTOR_BLOCKS;
+    }
+    return MIFARE_SMALL_SECTORS + (block_number - small_blocks) / MIFARE_LARGE_SECTOR_BLOCKS;
+}
+
+/**
+  * @brief: First block of the sector.
+  */
+uint16_t Mifare_SectorFirstBlock(uint8_t sector) {
+    if (sector < MIFARE_SMALL_SECTORS) {
+        return sector * MIFARE_SMALL_SECTOR_BLOCKS;
+    }
+    return MIFARE_SMALL_SECTORS * MIFARE_SMALL_SECTOR_BLOCKS
+        + (sector - MIFARE_SMALL_SECTORS) * MIFARE_LARGE_SECTOR_BLOCKS;
+}
+
+/**
+  * @brief: Number of blocks in the sector, trailer included.
+  */
+uint8_t Mifare_SectorBlocks(uint8_t sector) {
+    return sector < MIFARE_SMALL_SECTORS ? MIFARE_SMALL_SECTOR_BLOCKS : MIFARE_LARGE_SECTOR_BLOCKS;
+}
+
+/**
+  * @brief: Sector trailer block (keys and access bits) of the sector.
+  */
+uint16_t Mifare_SectorTrailer(uint8_t sector) {
+    return Mifare_SectorFirstBlock(sector) + Mifare_SectorBlocks(sector) - 1;
+}
+
+/**
+  * @brief: Check if the block is a sector trailer.
+  */
+bool Mifare_IsTrailer(uint16_t block_number) {
+    return Mifare_SectorTrailer(Mifare_BlockToSector(block_number)) == block_number;
+}
+
+/**
+  * @brief: Decode access bits (bytes 6-8) of the sector trailer.
+  * @param trailer: 16 bytes of sector trailer.
+  * @param access: decoded access conditions with MIFARE_ACCESS_KNOWN set.
+  * @retval: -1 if the inverted copies of the bits do not match.
+  */
+int Mifare_DecodeAccessBits(uint8_t* trailer, uint16_t* access) {
+    uint8_t c1 = trailer[7] >> 4;
+    uint8_t c2 = trailer[8] & 0x0F;
+    uint8_t c3 = trailer[8] >> 4;
+    if ((trailer[6] & 0x0F) != (~c1 & 0x0F)
+        || (trailer[6] >> 4) != (~c2 & 0x0F)
+        || (trailer[7] & 0x0F) != (~c3 & 0x0F)) {
+        return PN532_STATUS_ERROR;
+    }
+    *access = MIFARE_ACCESS_KNOWN;
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t cond = ((c1 >> i) & 1) << 2 | ((c2 >> i) & 1) << 1 | ((c3 >> i) & 1);
+        *access |= cond << (i * 3);
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Keys allowed to read the block under decoded access conditions.
+  *     Key B can not authenticate while it is readable from the trailer.
+  * @retval: MIFARE_ACCESS_KEY_A/B mask, 0 if the block is never readable.
+  */
+uint8_t Mifare_BlockAccess(uint16_t access, uint16_t block_number) {
+    uint8_t sector = Mifare_BlockToSector(block_number);
+    uint8_t index = block_number - Mifare_SectorFirstBlock(sector);
+    uint8_t trailer = (access >> (MIFARE_ACCESS_TRAILER_GROUP * 3)) & 0x07;
+    uint8_t group, keys;
+    if (Mifare_IsTrailer(block_number)) {
+        return TRAILER_READ[trailer];
+    }
+    // Groups of 5 blocks in large sectors
+    group = Mifare_SectorBlocks(sector) == MIFARE_LARGE_SECTOR_BLOCKS ? index / 5 : index;
+    keys = DATA_READ[(access >> (group * 3)) & 0x07];
+    if (trailer <= 2) {
+        keys &= ~MIFARE_ACCESS_KEY_B;
+    }
+    return keys;
+}
+
+/**
+  * @brief: Find cached access conditions of the card, or take a free entry
+  *     (replacing the oldest one) for it.
+  */
+Mifare_AccessEntry* Mifare_AccessLookup(Mifare_AccessCache* cache, uint8_t* uid, uint8_t uid_length) {
+    Mifare_AccessEntry* entry;
+    for (uint8_t i = 0; i < MIFARE_ACCESS_CACHE_SIZE; i++) {
+        entry = cache->entries + i;
+        if (entry->uid_length == uid_length && memcmp(entry->uid, uid, uid_length) == 0) {
+            return entry;
+        }
+    }
+    entry = cache->entries + cache->next;
+    cache->next = (cache->next + 1) % MIFARE_ACCESS_CACHE_SIZE;
+    memset(entry, 0, sizeof(Mifare_AccessEntry));
+    memcpy(entry->uid, uid, uid_length);
+    entry->uid_length = uid_length;
+    return entry;
+}
+
+/**
+  * @brief: Build a value block.
+  * @param address: byte kept with the value, e.g. the block number for backups.
+  */
+void Mifare_EncodeValue(int32_t value, uint8_t address, uint8_t* block) {
+    uint32_t v = (uint32_t)value;
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t b = (v >> (i * 8)) & 0xFF;
+        block[i] = b;
+        block[4 + i] = ~b;
+        block[8 + i] = b;
+    }
+    block[12] = address;
+    block[13] = ~address;
+    block[14] = address;
+    block[15] = ~address;
+}
+
+/**
+  * @brief: Check the redundant copies of a value block and decode it.
+  * @retval: PN532_STATUS_OK or MIFARE_VALUE_INVALID.
+  */
+int Mifare_DecodeValue(const uint8_t* block, int32_t* value, uint8_t* address) {
+    uint32_t v = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (block[i] != block[8 + i] || (block[i] ^ block[4 + i]) != 0xFF) {
+            return MIFARE_VALUE_INVALID;
+        }
+        v |= (uint32_t)block[i] << (i * 8);
+    }
+    if (block[12] != block[14] || (block[12] ^ block[13]) != 0xFF || block[13] != block[15]) {
+        return MIFARE_VALUE_INVALID;
+    }
+    *value = (int32_t)v;
+    if (address) {
+        *address = block[12];
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Run value operations inside one sector authentication, then read
+  *     back every transferred block once. Round-trips: 1 auth, 2 per
+  *     operation, 1 read per distinct transfer block.
+  * @param values: verified value of ops[i].transfer after the batch, may be NULL.
+  * @retval: PN532 error code, MIFARE_VALUE_SECTOR or MIFARE_VALUE_INVALID.
+  */
+int Mifare_ValueBatch(PN532* pn532, uint8_t* uid, uint8_t uid_length, uint8_t key_number, uint8_t* key,
+                      const Mifare_ValueOp* ops, uint8_t count, int32_t* values) {
+    uint8_t buff[MIFARE_BLOCK_LENGTH];
+    int32_t read[MIFARE_VALUE_OPS_MAX];
+    uint8_t sector, i, j;
+    int ret;
+    if (count == 0 || count > MIFARE_VALUE_OPS_MAX) {
+        return PN532_ERROR_INVAL;
+    }
+    sector = Mifare_BlockToSector(ops[0].block);
+    for (i = 0; i < count; i++) {
+        if (Mifare_BlockToSector(ops[i].block) != sector || Mifare_BlockToSector(ops[i].transfer) != sector
+            || Mifare_IsTrailer(ops[i].block) || Mifare_IsTrailer(ops[i].transfer)) {
+            return MIFARE_VALUE_SECTOR;
+        }
+    }
+    ret = PN532_MifareClassicAuthenticateBlock(pn532, uid, uid_length, ops[0].block, key_number, key);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    for (i = 0; i < count; i++) {
+        ret = PN532_MifareClassicValueOperation(pn532, ops[i].command, ops[i].block, ops[i].operand);
+        if (ret == PN532_ERROR_NONE) {
+            ret = PN532_MifareClassicTransfer(pn532, ops[i].transfer);
+        }
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < i && ops[j].transfer != ops[i].transfer; j++);
+        if (j < i) {
+            read[i] = read[j];
+            continue;
+        }
+        ret = PN532_MifareClassicReadBlock(pn532, buff, ops[i].transfer);
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+        if (Mifare_DecodeValue(buff, &read[i], NULL) != PN532_STATUS_OK) {
+            return MIFARE_VALUE_INVALID;
+        }
+    }
+    if (values) {
+        for (i = 0; i < count; i++) {
+            values[i] = read[i];
+        }
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Subtract amount from a value block in 4 round-trips: auth, read,
+  *     decrement and transfer. The balance is checked on the read, so a
+  *     debit which would leave the value negative never reaches the card.
+  * @param balance: value after the debit, or the current value if it is
+  *     insufficient.
+  * @retval: PN532 error code, MIFARE_VALUE_SECTOR, MIFARE_VALUE_INVALID or
+  *     MIFARE_VALUE_INSUFFICIENT.
+  */
+int Mifare_Debit(PN532* pn532, uint8_t* uid, uint8_t uid_length, uint8_t key_number, uint8_t* key,
+                 uint8_t block, uint32_t amount, int32_t* balance) {
+    uint8_t buff[MIFARE_BLOCK_LENGTH];
+    int32_t value;
+    int ret;
+    if (Mifare_IsTrailer(block)) {
+        return MIFARE_VALUE_SECTOR;
+    }
+    ret = PN532_MifareClassicAuthenticateBlock(pn532, uid, uid_length, block, key_number, key);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    ret = PN532_MifareClassicReadBlock(pn532, buff, block);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    if (Mifare_DecodeValue(buff, &value, NULL) != PN532_STATUS_OK) {
+        return MIFARE_VALUE_INVALID;
+    }
+    *balance = value;
+    if (value < 0 || (uint32_t)value < amount) {
+        return MIFARE_VALUE_INSUFFICIENT;
+    }
+    ret = PN532_MifareClassicValueOperation(pn532, MIFARE_CMD_DECREMENT, block, amount);
+    if (ret == PN532_ERROR_NONE) {
+        ret = PN532_MifareClassicTransfer(pn532, block);
+    }
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    *balance = value - (int32_t)amount;
+    return PN532_ERROR_NONE;
+}
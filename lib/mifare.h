@@ -0,0 +1,99 @@
+/**************************************************************************
+ *  @file     mifare.h
+ *  @license  BSD
+ *
+ *  Header file for mifare.c
+ *
+ *  MIFARE Classic card geometry. Mini, 1K and 2K cards have sectors of
+ *  4 blocks. A 4K card has 32 such sectors followed by 8 sectors of 16
+ *  blocks (sectors 32-39, blocks 128-255). The last block of every sector
+ *  is its trailer with keys and access bits. One authentication covers
+ *  the whole sector.
+ *
+ *  Value blocks keep a signed 32-bit value three times (once inverted)
+ *  and a one byte address four times. Increment, decrement and restore
+ *  load a value into the card transfer buffer, transfer writes it back.
+ **************************************************************************/
+
+#ifndef MIFARE_H
+#define MIFARE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIFARE_CLASSIC_MAX_BLOCKS           (256)
+#define MIFARE_CLASSIC_MAX_SECTORS          (40)
+#define MIFARE_SMALL_SECTORS                (32)    // sectors of 4 blocks
+#define MIFARE_SMALL_SECTOR_BLOCKS          (4)
+#define MIFARE_LARGE_SECTOR_BLOCKS          (16)
+
+// Keys allowed to read a block, 0 - block is never readable
+#define MIFARE_ACCESS_KEY_A                 (0x01)
+#define MIFARE_ACCESS_KEY_B                 (0x02)
+
+// Decoded access conditions of a sector: C1C2C3 of groups 0-3 in 3 bits each
+#define MIFARE_ACCESS_KNOWN                 (0x8000)
+#define MIFARE_ACCESS_TRAILER_GROUP         (3)
+#define MIFARE_ACCESS_CACHE_SIZE            (16)
+
+// Value blocks
+#define MIFARE_VALUE_OPS_MAX                (8)
+#define MIFARE_VALUE_INVALID                (0x80)  // block is not a valid value block
+#define MIFARE_VALUE_INSUFFICIENT           (0x81)  // balance lower than the debit, card not written
+#define MIFARE_VALUE_SECTOR                 (0x82)  // batch spans more than one sector
+
+/**
+  * One value operation: increment, decrement or restore (MIFARE_CMD_STORE)
+  * loads block into the transfer buffer, which is then written to transfer.
+  */
+typedef struct _Mifare_ValueOp {
+    uint8_t command;
+    uint8_t block;
+    uint32_t operand;       // ignored by restore
+    uint8_t transfer;       // usually block itself, another block makes a backup
+} Mifare_ValueOp;
+
+typedef struct _Mifare_AccessEntry {
+    uint8_t uid_length;     // 0 - free entry
+    uint8_t uid[MIFARE_UID_MAX_LENGTH];
+    uint16_t sectors[MIFARE_CLASSIC_MAX_SECTORS];
+} Mifare_AccessEntry;
+
+/**
+  * Decoded access conditions per card UID and sector.
+  * Entries are replaced round robin when the cache is full.
+  */
+typedef struct _Mifare_AccessCache {
+    Mifare_AccessEntry entries[MIFARE_ACCESS_CACHE_SIZE];
+    uint8_t next;
+} Mifare_AccessCache;
+
+uint8_t Mifare_SectorCount(uint8_t card_type);
+uint16_t Mifare_BlockCount(uint8_t card_type);
+uint8_t Mifare_BlockToSector(uint16_t block_number);
+uint16_t Mifare_SectorFirstBlock(uint8_t sector);
+uint8_t Mifare_SectorBlocks(uint8_t sector);
+uint16_t Mifare_SectorTrailer(uint8_t sector);
+bool Mifare_IsTrailer(uint16_t block_number);
+int Mifare_DecodeAccessBits(uint8_t* trailer, uint16_t* access);
+uint8_t Mifare_BlockAccess(uint16_t access, uint16_t block_number);
+void Mifare_EncodeValue(int32_t value, uint8_t address, uint8_t* block);
+int Mifare_DecodeValue(const uint8_t* block, int32_t* value, uint8_t* address);
+int Mifare_ValueBatch(PN532* pn532, uint8_t* uid, uint8_t uid_length, uint8_t key_number, uint8_t* key,
+                      const Mifare_ValueOp* ops, uint8_t count, int32_t* values);
+int Mifare_Debit(PN532* pn532, uint8_t* uid, uint8_t uid_length, uint8_t key_number, uint8_t* key,
+                 uint8_t block, uint32_t amount, int32_t* balance);
+Mifare_AccessEntry* Mifare_AccessLookup(Mifare_AccessCache* cache, uint8_t* uid, uint8_t uid_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* MIFARE_H */
+
+/* End of file */
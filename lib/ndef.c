@@ -0,0 +1,224 @@
+/**************************************************************************
+ *  @file     ndef.c
+ *  @license  BSD
+ *
+ *  Lazy NDEF reader for NFC Forum Type 2 tags and in-place record parser.
+ **************************************************************************/
+
+#include <string.h>
+#include "pn532.h"
+#include "ndef.h"
+
+// URI identifier codes, NDEF_URIPREFIX_NONE ... NDEF_URIPREFIX_URN_NFC
+static const char* const URI_PREFIXES[] = {
+    "", "http://www.", "https://www.", "http://", "https://", "tel:", "mailto:",
+    "ftp://anonymous:anonymous@", "ftp://ftp.", "ftps://", "sftp://", "smb://",
+    "nfs://", "ftp://", "dav://", "news:", "telnet://", "imap:", "rtsp://",
+    "urn:", "pop:", "sip:", "sips:", "tftp:", "btspp://", "btl2cap://",
+    "btgoep://", "tcpobex://", "irdaobex://", "file://", "urn:epc:id:",
+    "urn:epc:tag:", "urn:epc:pat:", "urn:epc:raw:", "urn:epc:", "urn:nfc:"
+};
+
+/**
+  * @brief: Decide once per tag kind whether FAST_READ is worth a GET_VERSION.
+  *     NTAG21x and Ultralight EV1 answer GET_VERSION and support FAST_READ,
+  *     older tags NAK it and have to be selected again.
+  */
+static void Ndef_ProbeFastRead(NdefReader* ndef, PN532* pn532, PN532_Target* target) {
+    uint8_t version[NTAG2XX_VERSION_LENGTH];
+    ndef->reads++;
+    if (PN532_Ntag2xxGetVersion(pn532, version) == PN532_ERROR_NONE) {
+        ndef->fast_read = NDEF_FAST_READ_YES;
+        return;
+    }
+    ndef->fast_read = NDEF_FAST_READ_NO;
+    ndef->reads++;
+    PN532_SelectTarget(pn532, target->tg);
+}
+
+/**
+  * @brief: Make sure buff holds bytes up to end (exclusive), reading from the
+  *     first missing page. Anything needing more than two READs goes out as
+  *     one FAST_READ when the tag supports it.
+  * @retval: PN532 error code, NDEF_ERROR_FORMAT past the end of the buffer.
+  */
+static int Ndef_Load(NdefReader* ndef, PN532* pn532, PN532_Target* target, uint16_t end) {
+    uint16_t page, last, pages;
+    int ret;
+    if (end > NDEF_BUFFER_LENGTH) {
+        return NDEF_ERROR_FORMAT;
+    }
+    while (ndef->loaded < end) {
+        page = NDEF_CC_PAGE + ndef->loaded / NTAG2XX_BLOCK_LENGTH;
+        pages = (end - ndef->loaded + NTAG2XX_BLOCK_LENGTH - 1) / NTAG2XX_BLOCK_LENGTH;
+        if (pages > 2 * NDEF_READ_PAGES && ndef->fast_read == NDEF_FAST_READ_UNKNOWN) {
+            Ndef_ProbeFastRead(ndef, pn532, target);
+        }
+        ndef->reads++;
+        if (pages > NDEF_READ_PAGES && ndef->fast_read == NDEF_FAST_READ_YES) {
+            if (pages > NTAG2XX_FAST_READ_MAX_PAGES) {
+                pages = NTAG2XX_FAST_READ_MAX_PAGES;
+            }
+            last = page + pages - 1;
+            ret = PN532_Ntag2xxFastRead(pn532, ndef->buff + ndef->loaded, page, last);
+        } else {
+            // READ returns 4 pages, the part past the buffer is not kept
+            pages = NDEF_READ_PAGES;
+            if (ndef->loaded + MIFARE_BLOCK_LENGTH > NDEF_BUFFER_LENGTH) {
+                return NDEF_ERROR_FORMAT;
+            }
+            ret = PN532_MifareClassicReadBlock(pn532, ndef->buff + ndef->loaded, page);
+        }
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+        ndef->loaded += pages * NTAG2XX_BLOCK_LENGTH;
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Read the capability container and walk the TLV blocks of the
+  *     data area until the NDEF message TLV is complete. The message view is
+  *     left in ndef->message, pages behind it are never read.
+  * @retval: PN532 error code, NDEF_ERROR_FORMAT or NDEF_ERROR_NO_MESSAGE.
+  */
+int Ndef_Read(NdefReader* ndef, PN532* pn532, PN532_Target* target) {
+    const uint8_t* cc = ndef->buff;
+    uint16_t offset, length, data_end;
+    uint8_t type, header;
+    int ret;
+    ndef->loaded = 0;
+    ndef->reads = 0;
+    ndef->message = NULL;
+    ndef->message_length = 0;
+    ret = Ndef_Load(ndef, pn532, target, MIFARE_BLOCK_LENGTH);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    if (cc[0] != NDEF_CC_MAGIC) {
+        return NDEF_ERROR_FORMAT;
+    }
+    ndef->version = cc[1];
+    ndef->size = cc[2] * 8;
+    ndef->access = cc[3];
+    // Data area offsets are relative to page 4, the CC page comes first in buff
+    offset = NTAG2XX_BLOCK_LENGTH;
+    data_end = NTAG2XX_BLOCK_LENGTH + ndef->size;
+    while (offset < data_end) {
+        ret = Ndef_Load(ndef, pn532, target, offset + 1);
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+        type = ndef->buff[offset];
+        if (type == NDEF_TLV_NULL) {
+            offset++;
+            continue;
+        }
+        if (type == NDEF_TLV_TERMINATOR) {
+            break;
+        }
+        // One byte length, or 0xFF and two bytes big endian
+        ret = Ndef_Load(ndef, pn532, target, offset + 4 < data_end ? offset + 4 : data_end);
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+        if (offset + 2 > data_end) {
+            return NDEF_ERROR_FORMAT;
+        }
+        length = ndef->buff[offset + 1];
+        header = 2;
+        if (length == 0xFF) {
+            if (offset + 4 > data_end) {
+                return NDEF_ERROR_FORMAT;
+            }
+            length = (ndef->buff[offset + 2] << 8) | ndef->buff[offset + 3];
+            header = 4;
+        }
+        if (offset + header + length > data_end) {
+            return NDEF_ERROR_FORMAT;
+        }
+        if (type == NDEF_TLV_MESSAGE) {
+            ret = Ndef_Load(ndef, pn532, target, offset + header + length);
+            if (ret != PN532_ERROR_NONE) {
+                return ret;
+            }
+            ndef->message = ndef->buff + offset + header;
+            ndef->message_length = length;
+            return PN532_ERROR_NONE;
+        }
+        offset += header + length;
+    }
+    return NDEF_ERROR_NO_MESSAGE;
+}
+
+/**
+  * @brief: Parse the record at offset of the message and move offset past it.
+  * @retval: PN532_ERROR_NONE, NDEF_ERROR_NO_MESSAGE at the end of the message
+  *     or NDEF_ERROR_FORMAT if the record does not fit.
+  */
+int Ndef_NextRecord(const uint8_t* message, uint16_t length, uint16_t* offset, NdefRecord* record) {
+    uint32_t pos = *offset;
+    if (pos >= length) {
+        return NDEF_ERROR_NO_MESSAGE;
+    }
+    memset(record, 0, sizeof(NdefRecord));
+    record->header = message[pos++];
+    record->tnf = record->header & NDEF_RECORD_TNF_MASK;
+    if (pos >= length) {
+        return NDEF_ERROR_FORMAT;
+    }
+    record->type_length = message[pos++];
+    if (record->header & NDEF_RECORD_SR) {
+        if (pos + 1 > length) {
+            return NDEF_ERROR_FORMAT;
+        }
+        record->payload_length = message[pos++];
+    } else {
+        if (pos + 4 > length) {
+            return NDEF_ERROR_FORMAT;
+        }
+        record->payload_length = ((uint32_t)message[pos] << 24) | (message[pos + 1] << 16)
+                                 | (message[pos + 2] << 8) | message[pos + 3];
+        pos += 4;
+    }
+    if (record->header & NDEF_RECORD_IL) {
+        if (pos + 1 > length) {
+            return NDEF_ERROR_FORMAT;
+        }
+        record->id_length = message[pos++];
+    }
+    // Each part against the bytes left, a 32-bit payload length must not wrap a sum
+    if ((uint32_t)record->type_length + record->id_length > length - pos
+        || record->payload_length > length - pos - record->type_length - record->id_length) {
+        return NDEF_ERROR_FORMAT;
+    }
+    record->type = message + pos;
+    pos += record->type_length;
+    record->id = message + pos;
+    pos += record->id_length;
+    record->payload = message + pos;
+    pos += record->payload_length;
+    *offset = pos;
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Well-known URI record ("U"), payload is a prefix code and the rest of the URI.
+  */
+bool Ndef_IsUri(const NdefRecord* record) {
+    return record->tnf == NDEF_TNF_WELL_KNOWN && record->type_length == 1
+           && record->type[0] == 'U' && record->payload_length >= 1;
+}
+
+/**
+  * @brief: Text of a URI identifier code (NDEF_URIPREFIX_*), "" if unknown.
+  */
+const char* Ndef_UriPrefix(uint8_t code) {
+    if (code >= sizeof(URI_PREFIXES) / sizeof(URI_PREFIXES[0])) {
+        return "";
+    }
+    return URI_PREFIXES[code];
+}
+
+/* End of file */
@@ -0,0 +1,102 @@
+/**************************************************************************
+ *  @file     ndef.h
+ *  @license  BSD
+ *
+ *  Header file for ndef.c
+ *
+ *  NFC Forum Type 2 tag (Ultralight/NTAG) NDEF reader. Page 3 holds the
+ *  capability container, the data area starts at page 4 with TLV blocks.
+ *  Pages are read only as far as the TLV walk needs them, so a short
+ *  message costs two READs whatever the tag size. Records are parsed in
+ *  place, their views point into the page buffer of the reader.
+ **************************************************************************/
+
+#ifndef NDEF_H
+#define NDEF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NDEF_CC_PAGE                        (3)
+#define NDEF_CC_MAGIC                       (0xE1)
+#define NDEF_BUFFER_LENGTH                  (1024)  // CC and data area of NTAG216
+#define NDEF_READ_PAGES                     (4)     // pages returned by one READ
+
+// TLV blocks of the data area
+#define NDEF_TLV_NULL                       (0x00)
+#define NDEF_TLV_LOCK_CONTROL               (0x01)
+#define NDEF_TLV_MEMORY_CONTROL             (0x02)
+#define NDEF_TLV_MESSAGE                    (0x03)
+#define NDEF_TLV_PROPRIETARY                (0xFD)
+#define NDEF_TLV_TERMINATOR                 (0xFE)
+
+// Record header
+#define NDEF_RECORD_MB                      (0x80)  // message begin
+#define NDEF_RECORD_ME                      (0x40)  // message end
+#define NDEF_RECORD_CF                      (0x20)  // chunk
+#define NDEF_RECORD_SR                      (0x10)  // short record, 1-byte payload length
+#define NDEF_RECORD_IL                      (0x08)  // ID length present
+#define NDEF_RECORD_TNF_MASK                (0x07)
+
+#define NDEF_TNF_EMPTY                      (0x00)
+#define NDEF_TNF_WELL_KNOWN                 (0x01)
+#define NDEF_TNF_MIME                       (0x02)
+#define NDEF_TNF_ABSOLUTE_URI               (0x03)
+#define NDEF_TNF_EXTERNAL                   (0x04)
+
+// FAST_READ support
+#define NDEF_FAST_READ_UNKNOWN              (0)
+#define NDEF_FAST_READ_YES                  (1)
+#define NDEF_FAST_READ_NO                   (2)
+
+// Errors besides PN532 error codes
+#define NDEF_ERROR_FORMAT                   (0x90)  // no capability container or broken TLV/record
+#define NDEF_ERROR_NO_MESSAGE               (0x91)  // terminator or end of data area before an NDEF TLV
+
+/**
+  * Pages read from the tag, buff[0] is page 3 (CC). message points to the
+  * NDEF message inside buff once Ndef_Read succeeded.
+  */
+typedef struct _NdefReader {
+    uint8_t buff[NDEF_BUFFER_LENGTH];
+    uint16_t loaded;        // bytes of buff read from the tag
+    uint16_t size;          // data area bytes announced by the CC
+    uint8_t version;
+    uint8_t access;
+    uint8_t fast_read;      // NDEF_FAST_READ_*, keep between cards of the same kind
+    uint16_t reads;         // round-trips of the last Ndef_Read
+    const uint8_t* message;
+    uint16_t message_length;
+} NdefReader;
+
+/**
+  * View of one record, all pointers point into the message.
+  */
+typedef struct _NdefRecord {
+    uint8_t header;         // MB ME CF SR IL TNF
+    uint8_t tnf;
+    const uint8_t* type;
+    uint8_t type_length;
+    const uint8_t* id;
+    uint8_t id_length;
+    const uint8_t* payload;
+    uint32_t payload_length;
+} NdefRecord;
+
+int Ndef_Read(NdefReader* ndef, PN532* pn532, PN532_Target* target);
+int Ndef_NextRecord(const uint8_t* message, uint16_t length, uint16_t* offset, NdefRecord* record);
+bool Ndef_IsUri(const NdefRecord* record);
+const char* Ndef_UriPrefix(uint8_t code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* NDEF_H */
+
+/* End of file */
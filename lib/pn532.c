@@ -28,14 +28,22 @@
  **************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include "pn532.h"
 
 const uint8_t PN532_ACK[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+const uint8_t PN532_NACK[] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
 const uint8_t PN532_FRAME_START[] = {0x00, 0x00, 0xFF};
 
 #define PN532_FRAME_MAX_LENGTH              255
 #define PN532_DEFAULT_TIMEOUT               1000
 
+// Transceive results besides the frame length
+#define PN532_LINK_TIMEOUT                  (-1)    // no response after the ACK
+#define PN532_LINK_RESEND                   (-2)    // command was not acknowledged
+#define PN532_LINK_CORRUPT                  (-3)    // response lost after NACK retries
+#define PN532_LINK_SILENT                   (-4)    // no ACK in time
+
 /**
   * @brief: Write a frame to the PN532 of at most length bytes in size.
   *     Note that less than length bytes might be returned!
@@ -84,8 +92,14 @@ int PN532_WriteFrame(PN532* pn532, uint8_t* data, uint16_t length) {
 int PN532_ReadFrame(PN532* pn532, uint8_t* response, uint16_t length) {
     uint8_t buff[PN532_FRAME_MAX_LENGTH + 7];
     uint8_t checksum = 0;
+    if (length > PN532_FRAME_MAX_LENGTH) {
+        return PN532_STATUS_ERROR;
+    }
     // Read frame with expected length of data.
-    pn532->read_data(buff, length + 7);
+    if (pn532->read_data(buff, length + 7) != PN532_STATUS_OK) {
+        pn532->log("Failed to read response frame");
+        return PN532_STATUS_ERROR;
+    }
     // Swallow all the 0x00 values that preceed 0xFF.
     uint8_t offset = 0;
     while (buff[offset] == 0x00) {
@@ -110,8 +124,12 @@ int PN532_ReadFrame(PN532* pn532, uint8_t* response, uint16_t length) {
         pn532->log("Response length checksum did not match length!");
         return PN532_STATUS_ERROR;
     }
-    // Check frame checksum value matches bytes.
-    for (uint8_t i = 0; i < frame_len + 1; i++) {
+    if (offset + 2 + frame_len >= length + 7) {
+        pn532->log("Response frame is longer than expected!");
+        return PN532_STATUS_ERROR;
+    }
+    // Check frame checksum value matches bytes, a full frame has 256 of them.
+    for (uint16_t i = 0; i < frame_len + 1; i++) {
         checksum += buff[offset + 2 + i];
     }
     checksum &= 0xFF;
@@ -127,60 +145,176 @@ int PN532_ReadFrame(PN532* pn532, uint8_t* response, uint16_t length) {
 }
 
 /**
-  * @brief: Send specified command to the PN532 and expect up to response_length.
-  *     Will wait up to timeout seconds for a response and read a bytearray into
-  *     response buffer.
-  * @param pn532: PN532 handler
-  * @param command: command to send
-  * @param response: buffer returned
-  * @param response_length: expected response length
-  * @param params: can optionally specify an array of bytes to send as parameters
-  *     to the function call, or NULL if there is no need to send parameters.
-  * @param params_length: length of the argument params
-  * @param timeout: timout of systick
-  * @retval: Returns the length of response or -1 if error.
+  * @brief: Sleep between recovery attempts, doubling the pause every attempt.
   */
-int PN532_CallFunction(
+static void PN532_Backoff(PN532* pn532, uint8_t attempt) {
+    if (pn532->delay) {
+        pn532->delay(PN532_BACKOFF_MS << attempt);
+    }
+}
+
+static void PN532_LatencyUpdate(PN532_Latency* model, uint32_t us) {
+    int32_t err;
+    if (model->samples++ == 0) {
+        model->mean_us = us;
+        model->dev_us = us / 2;
+        return;
+    }
+    err = (int32_t)us - (int32_t)model->mean_us;
+    model->mean_us += err / 8;
+    err = (err < 0 ? -err : err) - (int32_t)model->dev_us;
+    model->dev_us += err / 4;
+}
+
+/**
+  * @brief: Wait for the PN532 to be ready, scheduled by the latency model of
+  *     the expected answer. Sleeps until just before the predicted completion,
+  *     then checks readiness with exponentially growing pauses. Transports
+  *     without is_ready/micros, or pn532->fixed_polling, use wait_ready.
+  */
+static bool PN532_WaitReady(PN532* pn532, PN532_Latency* model, uint32_t timeout) {
+    uint32_t start, elapsed, ahead, step = 1;
+    if (pn532->fixed_polling || !pn532->is_ready || !pn532->micros || !pn532->delay) {
+        return pn532->wait_ready(timeout);
+    }
+    start = pn532->micros();
+    if (model->samples >= PN532_LATENCY_WARMUP && model->mean_us > 2 * model->dev_us) {
+        ahead = (model->mean_us - 2 * model->dev_us) / 1000;
+        if (ahead > 0 && ahead < timeout) {
+            pn532->delay(ahead);
+        }
+    }
+    while (1) {
+        pn532->polls++;
+        if (pn532->is_ready()) {
+            PN532_LatencyUpdate(model, pn532->micros() - start);
+            return true;
+        }
+        elapsed = pn532->micros() - start;
+        if (elapsed / 1000 > timeout) {
+            return false;
+        }
+        pn532->delay(step);
+        if (step < PN532_POLL_MAX_MS) {
+            step <<= 1;
+        }
+    }
+}
+
+/**
+  * @brief: Send one command frame and read its response frame.
+  *     A corrupted response is requested again with a NACK frame, which makes
+  *     the PN532 retransmit its last response without running the command again.
+  * @retval: Returns frame length or one of PN532_LINK_* codes.
+  */
+static int PN532_Transceive(
+    PN532* pn532,
+    uint8_t* frame,
+    uint16_t frame_length,
+    uint8_t* response,
+    uint16_t response_length,
+    uint32_t timeout
+) {
+    uint8_t ack[sizeof(PN532_ACK)];
+    uint8_t nack[sizeof(PN532_NACK)];
+    PN532_Latency* model = pn532->latency + (frame[1] >> 1) % PN532_LATENCY_SLOTS;
+    if (PN532_WriteFrame(pn532, frame, frame_length) != PN532_STATUS_OK) {
+        return PN532_LINK_RESEND;
+    }
+    if (!PN532_WaitReady(pn532, &pn532->ack_latency, timeout)) {
+        return PN532_LINK_SILENT;
+    }
+    // Verify ACK response and wait to be ready for function response.
+    if (pn532->read_data(ack, sizeof(ack)) != PN532_STATUS_OK) {
+        return PN532_LINK_RESEND;
+    }
+    for (uint8_t i = 0; i < sizeof(PN532_ACK); i++) {
+        if (PN532_ACK[i] != ack[i]) {
+            pn532->log("Did not receive expected ACK from PN532!");
+            return PN532_LINK_RESEND;
+        }
+    }
+    for (uint8_t attempt = 0; ; attempt++) {
+        if (!PN532_WaitReady(pn532, model, timeout)) {
+            return PN532_LINK_TIMEOUT;
+        }
+        int frame_len = PN532_ReadFrame(pn532, response, response_length);
+        if (frame_len >= 0) {
+            return frame_len;
+        }
+        if (attempt >= PN532_NACK_RETRIES) {
+            return PN532_LINK_CORRUPT;
+        }
+        // Ask for the same response again.
+        pn532->recovery.nacks++;
+        PN532_Backoff(pn532, attempt);
+        for (uint8_t i = 0; i < sizeof(PN532_NACK); i++) {
+            nack[i] = PN532_NACK[i];
+        }
+        if (pn532->write_data(nack, sizeof(nack)) != PN532_STATUS_OK) {
+            return PN532_LINK_CORRUPT;
+        }
+    }
+}
+
+/**
+  * @brief: Send a command and read its response, see PN532_CallFunction.
+  * @param recover: resend lost commands and wake up the PN532 on repeated
+  *     failures, otherwise give up after the first attempt.
+  */
+static int PN532_Call(
     PN532* pn532,
     uint8_t command,
     uint8_t* response,
     uint16_t response_length,
     uint8_t* params,
     uint16_t params_length,
-    uint32_t timeout
+    uint32_t timeout,
+    bool recover
 ) {
     // Build frame data with command and parameters.
+    uint8_t frame[PN532_FRAME_MAX_LENGTH];
     uint8_t buff[PN532_FRAME_MAX_LENGTH];
-    buff[0] = PN532_HOSTTOPN532;
-    buff[1] = command & 0xFF;
-    for (uint8_t i = 0; i < params_length; i++) {
-        buff[2 + i] = params[i];
-    }
-    // Send frame and wait for response.
-    if (PN532_WriteFrame(pn532, buff, params_length + 2) != PN532_STATUS_OK) {
-        pn532->wakeup();
-        pn532->log("Trying to wakeup");
+    int frame_len = PN532_LINK_RESEND;
+    if (params_length + 2 > PN532_FRAME_MAX_LENGTH
+        || response_length + 2 > PN532_FRAME_MAX_LENGTH) {
         return PN532_STATUS_ERROR;
     }
-    if (!pn532->wait_ready(timeout)) {
-        return PN532_STATUS_ERROR;
+    frame[0] = PN532_HOSTTOPN532;
+    frame[1] = command & 0xFF;
+    for (uint8_t i = 0; i < params_length; i++) {
+        frame[2 + i] = params[i];
     }
-    // Verify ACK response and wait to be ready for function response.
-    pn532->read_data(buff, sizeof(PN532_ACK));
-    for (uint8_t i = 0; i < sizeof(PN532_ACK); i++) {
-        if (PN532_ACK[i] != buff[i]) {
-            pn532->log("Did not receive expected ACK from PN532!");
-            return PN532_STATUS_ERROR;
+    // Send frame and wait for response, resending lost commands.
+    uint8_t attempts = recover ? PN532_RESEND_RETRIES : 0;
+    for (uint8_t attempt = 0; attempt <= attempts; attempt++) {
+        if (attempt > 0) {
+            pn532->recovery.resends++;
+            PN532_Backoff(pn532, attempt);
+        }
+        frame_len = PN532_Transceive(pn532, frame, params_length + 2,
+                                     buff, response_length + 2, timeout);
+        if (frame_len != PN532_LINK_RESEND) {
+            break;
         }
     }
-    if (!pn532->wait_ready(timeout)) {
+    if (frame_len < 0) {
+        // A missing response after the ACK is a normal outcome (e.g. no card).
+        if (recover && frame_len != PN532_LINK_TIMEOUT) {
+            pn532->recovery.failures++;
+            if (++pn532->recovery.consecutive >= PN532_WAKEUP_THRESHOLD) {
+                pn532->log("Trying to wakeup");
+                pn532->recovery.wakeups++;
+                pn532->recovery.consecutive = 0;
+                pn532->wakeup();
+            }
+        }
         return PN532_STATUS_ERROR;
     }
-    // Read response bytes.
-    int frame_len = PN532_ReadFrame(pn532, buff, response_length + 2);
+    pn532->recovery.consecutive = 0;
 
     // Check that response is for the called function.
-    if (! ((buff[0] == PN532_PN532TOHOST) && (buff[1] == (command+1)))) {
+    if (frame_len < 2 || ! ((buff[0] == PN532_PN532TOHOST) && (buff[1] == (command+1)))) {
         pn532->log("Received unexpected command response!");
         return PN532_STATUS_ERROR;
     }
@@ -192,6 +326,36 @@ int PN532_CallFunction(
     return frame_len - 2;
 }
 
+/**
+  * @brief: Send specified command to the PN532 and expect up to response_length.
+  *     Will wait up to timeout seconds for a response and read a bytearray into
+  *     response buffer.
+  *     Link errors are recovered in tiers: a corrupted response is requested
+  *     again with NACK, a lost command is resent, and the PN532 is woken up
+  *     only after PN532_WAKEUP_THRESHOLD calls in a row have failed.
+  * @param pn532: PN532 handler
+  * @param command: command to send
+  * @param response: buffer returned
+  * @param response_length: expected response length
+  * @param params: can optionally specify an array of bytes to send as parameters
+  *     to the function call, or NULL if there is no need to send parameters.
+  * @param params_length: length of the argument params
+  * @param timeout: timout of systick
+  * @retval: Returns the length of response or -1 if error.
+  */
+int PN532_CallFunction(
+    PN532* pn532,
+    uint8_t command,
+    uint8_t* response,
+    uint16_t response_length,
+    uint8_t* params,
+    uint16_t params_length,
+    uint32_t timeout
+) {
+    return PN532_Call(pn532, command, response, response_length,
+                      params, params_length, timeout, true);
+}
+
 /**
   * @brief: Call PN532 GetFirmwareVersion function and return a buff with the IC,
   *  Ver, Rev, and Support values.
@@ -206,6 +370,94 @@ int PN532_GetFirmwareVersion(PN532* pn532, uint8_t* version) {
     return PN532_STATUS_OK;
 }
 
+/**
+  * @brief: Single GetFirmwareVersion attempt with no link recovery, used to
+  *     check whether the PN532 is already awake.
+  * @retval: -1 if the PN532 did not answer within timeout.
+  */
+int PN532_ProbeFirmwareVersion(PN532* pn532, uint8_t* version, uint32_t timeout) {
+    if (PN532_Call(pn532, PN532_COMMAND_GETFIRMWAREVERSION,
+                   version, 4, NULL, 0, timeout, false) == PN532_STATUS_ERROR) {
+        return PN532_STATUS_ERROR;
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Communication line test (Diagnose NumTst 0x00), the PN532 echoes
+  *     the data back. Single attempt with no link recovery.
+  * @retval: -1 if the call failed or the echo does not match.
+  */
+int PN532_EchoTest(PN532* pn532, uint8_t* data, uint8_t length) {
+    uint8_t params[PN532_ECHO_MAX_LENGTH + 1];
+    uint8_t response[PN532_ECHO_MAX_LENGTH + 1];
+    if (length > PN532_ECHO_MAX_LENGTH) {
+        return PN532_STATUS_ERROR;
+    }
+    params[0] = PN532_DIAGNOSE_COMMLINE;
+    for (uint8_t i = 0; i < length; i++) {
+        params[1 + i] = data[i];
+    }
+    if (PN532_Call(pn532, PN532_COMMAND_DIAGNOSE, response, length + 1,
+                   params, length + 1, PN532_DEFAULT_TIMEOUT, false) != length + 1) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint8_t i = 0; i < length + 1; i++) {
+        if (response[i] != params[i]) {
+            return PN532_STATUS_ERROR;
+        }
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Find the fastest clock the link runs at without errors.
+  *     Rates are tried in ascending order, each with a burst of echo tests
+  *     and GetFirmwareVersion calls. Any failed call or NACK retransmit
+  *     makes the rate unstable and stops the search.
+  * @param rates: clock rates in Hz, ascending.
+  * @param count: number of rates.
+  * @param burst: calls per rate.
+  * @retval: chosen clock rate (already applied), 0 if no rate is stable or
+  *     the transport clock is fixed.
+  */
+uint32_t PN532_CalibrateClock(PN532* pn532, const uint32_t* rates, uint8_t count, uint16_t burst) {
+    uint8_t data[PN532_ECHO_MAX_LENGTH];
+    uint8_t version[4];
+    uint32_t best = 0;
+    char msg[64];
+    if (!pn532->set_clock) {
+        return 0;
+    }
+    // Alternating and walking bit patterns
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i & 1) ? ((i & 2) ? 0xAA : 0x55) : 1 << ((i >> 1) & 7);
+    }
+    for (uint8_t r = 0; r < count; r++) {
+        uint32_t failures = 0;
+        uint32_t nacks = pn532->recovery.nacks;
+        if (pn532->set_clock(rates[r]) != PN532_STATUS_OK) {
+            break;
+        }
+        for (uint16_t i = 0; i < burst; i++) {
+            if (i & 1) {
+                failures += PN532_ProbeFirmwareVersion(pn532, version, PN532_DEFAULT_TIMEOUT) != PN532_STATUS_OK;
+            } else {
+                failures += PN532_EchoTest(pn532, data, sizeof(data)) != PN532_STATUS_OK;
+            }
+        }
+        failures += pn532->recovery.nacks - nacks;
+        snprintf(msg, sizeof(msg), "Clock %u Hz: %u failures of %u", rates[r], failures, burst);
+        pn532->log(msg);
+        if (failures > 0) {
+            break;
+        }
+        best = rates[r];
+    }
+    pn532->set_clock(best ? best : rates[0]);
+    return best;
+}
+
 /**
   * @brief: Configure the PN532 to read MiFare cards.
   */
@@ -222,6 +474,182 @@ int PN532_SamConfiguration(PN532* pn532) {
     return PN532_STATUS_OK;
 }
 
+/**
+  * @brief: Put the PN532 into power down, the RF field is switched off.
+  *     Any of the wake_sources (PN532_WAKE_*) brings it back, the host
+  *     interface in use should be one of them.
+  * @retval: PN532 error code.
+  */
+int PN532_PowerDown(PN532* pn532, uint8_t wake_sources) {
+    uint8_t status[1];
+    if (PN532_CallFunction(pn532, PN532_COMMAND_POWERDOWN, status, sizeof(status),
+                           &wake_sources, 1, PN532_DEFAULT_TIMEOUT) < 1) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    if (status[0] & 0x3F) {
+        return status[0] & 0x3F;
+    }
+    pn532->powered_down = true;
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Wake the PN532 from power down. The transport resume hook only
+  *     waits for the oscillator, the full wakeup sequence is the fallback.
+  *     Targets are released and CIU registers may have been reset.
+  * @retval: -1 if the transport failed to wake the PN532.
+  */
+int PN532_Resume(PN532* pn532) {
+    int ret = pn532->resume ? pn532->resume() : pn532->wakeup();
+    pn532->powered_down = false;
+    pn532->desfire_aid = 0;
+    PN532_InvalidateRegisters(pn532);
+    return ret;
+}
+
+/**
+  * @brief: Send one RFConfiguration item with its configuration data.
+  * @retval: PN532 error code.
+  */
+int PN532_RFConfiguration(PN532* pn532, uint8_t item, const uint8_t* data, uint8_t length) {
+    uint8_t params[1 + PN532_ANALOG_106A_LENGTH];
+    if (length > PN532_ANALOG_106A_LENGTH) {
+        return PN532_ERROR_INVAL;
+    }
+    params[0] = item;
+    for (uint8_t i = 0; i < length; i++) {
+        params[1 + i] = data[i];
+    }
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_RFCONFIGURATION,
+                                 NULL, 0, params, length + 1, PN532_DEFAULT_TIMEOUT);
+    if (ret < 0) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    if (item >= PN532_RFCFG_ANALOG_106A) {
+        PN532_InvalidateRegisters(pn532);
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Switch the RF field, auto_rfca waits for no external field first.
+  * @retval: PN532 error code.
+  */
+int PN532_SetRFField(PN532* pn532, bool on, bool auto_rfca) {
+    uint8_t data = (on ? PN532_RF_FIELD_ON : 0) |
+                   (auto_rfca ? PN532_RF_FIELD_AUTO_RFCA : 0);
+    return PN532_RFConfiguration(pn532, PN532_RFCFG_FIELD, &data, 1);
+}
+
+/**
+  * @brief: Set the ATR_RES timeout and the InDataExchange/InCommunicateThru
+  *     retry timeout, both as PN532_RF_TIMEOUT_* codes.
+  * @retval: PN532 error code.
+  */
+int PN532_SetRFTimings(PN532* pn532, uint8_t atr_res_timeout, uint8_t retry_timeout) {
+    uint8_t data[] = {0x00, atr_res_timeout, retry_timeout};
+    return PN532_RFConfiguration(pn532, PN532_RFCFG_TIMINGS, data, sizeof(data));
+}
+
+/**
+  * @brief: Set how many times InCommunicateThru retries a missing response.
+  * @retval: PN532 error code.
+  */
+int PN532_SetMaxRetryCom(PN532* pn532, uint8_t retries) {
+    return PN532_RFConfiguration(pn532, PN532_RFCFG_MAXRTYCOM, &retries, 1);
+}
+
+/**
+  * @brief: Set ATR_REQ, PSL_REQ and passive activation retries.
+  *     passive_activation 0 makes InListPassiveTarget try once and return
+  *     with no target instead of polling until the host timeout.
+  * @retval: PN532 error code.
+  */
+int PN532_SetMaxRetries(PN532* pn532, uint8_t atr, uint8_t psl, uint8_t passive_activation) {
+    uint8_t data[] = {atr, psl, passive_activation};
+    return PN532_RFConfiguration(pn532, PN532_RFCFG_MAXRETRIES, data, sizeof(data));
+}
+
+/**
+  * @brief: Load CIU analog settings used for 106 kbps type A.
+  * @retval: PN532 error code.
+  */
+int PN532_SetAnalog106A(PN532* pn532, const PN532_Analog106A* analog) {
+    uint8_t data[] = {
+        analog->rf_cfg, analog->gsn_on, analog->cw_gsp, analog->mod_gsp,
+        analog->demod_own_rf, analog->rx_threshold, analog->demod_not_own_rf,
+        analog->gsn_off, analog->mod_width, analog->mif_nfc, analog->tx_bit_phase
+    };
+    return PN532_RFConfiguration(pn532, PN532_RFCFG_ANALOG_106A, data, sizeof(data));
+}
+
+// PN532 power-on values for 106 kbps type A
+const PN532_Analog106A PN532_ANALOG_106A_DEFAULT = {
+    0x59, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87
+};
+
+// Maximum receiver gain (48 dB) for weak cards at the edge of the field
+static const PN532_Analog106A PN532_ANALOG_106A_LONG_RANGE = {
+    0x79, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87
+};
+
+static const PN532_RFPreset PN532_RFPresets[] = {
+    // Power-on configuration, InListPassiveTarget polls until the host timeout
+    {"default", PN532_RF_TIMEOUT_102MS, PN532_RF_TIMEOUT_51MS, 0x00,
+     PN532_RF_RETRIES_INFINITE, 0x01, PN532_RF_RETRIES_INFINITE,
+     &PN532_ANALOG_106A_DEFAULT},
+    // Single activation attempt, an empty poll returns in a few milliseconds
+    {"low-latency", PN532_RF_TIMEOUT_102MS, PN532_RF_TIMEOUT_25MS, 0x00,
+     0x01, 0x01, 0x00, NULL},
+    // Full receiver gain and longer timeouts, keeps polling
+    {"long-range", PN532_RF_TIMEOUT_409MS, PN532_RF_TIMEOUT_102MS, 0x02,
+     PN532_RF_RETRIES_INFINITE, 0x01, PN532_RF_RETRIES_INFINITE,
+     &PN532_ANALOG_106A_LONG_RANGE},
+};
+
+/**
+  * @brief: Look up a built-in RF preset by name.
+  * @retval: Preset, or NULL if unknown.
+  */
+const PN532_RFPreset* PN532_FindRFPreset(const char* name) {
+    for (uint8_t i = 0; i < sizeof(PN532_RFPresets) / sizeof(PN532_RFPresets[0]); i++) {
+        if (strcmp(PN532_RFPresets[i].name, name) == 0) {
+            return &PN532_RFPresets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief: Enumerate built-in RF presets.
+  * @retval: Preset, or NULL past the last one.
+  */
+const PN532_RFPreset* PN532_RFPresetAt(uint8_t index) {
+    if (index >= sizeof(PN532_RFPresets) / sizeof(PN532_RFPresets[0])) {
+        return NULL;
+    }
+    return &PN532_RFPresets[index];
+}
+
+/**
+  * @brief: Apply timings, retry counts and analog settings of a preset.
+  * @retval: PN532 error code of the first item that failed.
+  */
+int PN532_ApplyRFPreset(PN532* pn532, const PN532_RFPreset* preset) {
+    int ret = PN532_SetRFTimings(pn532, preset->atr_res_timeout, preset->retry_timeout);
+    if (ret == PN532_ERROR_NONE) {
+        ret = PN532_SetMaxRetryCom(pn532, preset->max_retry_com);
+    }
+    if (ret == PN532_ERROR_NONE) {
+        ret = PN532_SetMaxRetries(pn532, preset->max_retries_atr,
+                                  preset->max_retries_psl, preset->max_retries_passive);
+    }
+    if (ret == PN532_ERROR_NONE && preset->analog) {
+        ret = PN532_SetAnalog106A(pn532, preset->analog);
+    }
+    return ret;
+}
+
 /**
   * @brief: Wait for a MiFare card to be available and return its UID when found.
   *     Will wait up to timeout seconds and return None if no card is found,
@@ -233,29 +661,297 @@ int PN532_ReadPassiveTarget(
     uint8_t* response,
     uint8_t card_baud,
     uint32_t timeout
+) {
+    PN532_Target target;
+    int length = PN532_ReadPassiveTargetInfo(pn532, &target, card_baud, timeout);
+    if (length < 0) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint8_t i = 0; i < target.uid_length; i++) {
+        response[i] = target.uid[i];
+    }
+    return length;
+}
+
+/**
+  * @brief: Fill the target descriptor from 106 kbps type A target data
+  *     (Tg, SENS_RES, SEL_RES, UID length, UID, ATS) of InListPassiveTarget
+  *     or InAutoPoll.
+  * @retval: -1 if the target data is malformed.
+  */
+static int PN532_ParseTargetA(PN532* pn532, const uint8_t* data, int length, PN532_Target* target) {
+    if (length < 5 || data[4] > 7 || 5 + data[4] > length) {
+        pn532->log("Found card with unexpectedly long UID!");
+        return PN532_STATUS_ERROR;
+    }
+    target->tg = data[0];
+    target->atqa = (data[1] << 8) | data[2];
+    target->sak = data[3];
+    target->uid_length = data[4];
+    for (uint8_t i = 0; i < data[4]; i++) {
+        target->uid[i] = data[5 + i];
+    }
+    // ATS follows the UID for ISO14443-4 compliant targets, TL counts itself.
+    target->ats_length = 0;
+    uint8_t ofs = 5 + data[4];
+    if ((target->sak & PN532_SAK_ISO14443_4) && ofs < length) {
+        uint8_t tl = data[ofs];
+        if (tl > PN532_ATS_MAX_LENGTH || ofs + tl > length) {
+            pn532->log("Found card with malformed ATS!");
+        } else {
+            for (uint8_t i = 0; i < tl; i++) {
+                target->ats[i] = data[ofs + i];
+            }
+            target->ats_length = tl;
+        }
+    }
+    target->type = PN532_CardType(target->atqa, target->sak,
+                                  target->ats, target->ats_length);
+    // Activation reloaded the analog registers from the RFConfiguration settings
+    PN532_InvalidateRegisters(pn532);
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Wait for a MiFare card to be available and fill the target descriptor
+  *     (Tg, ATQA, SAK, UID and ATS when present) with the detected card type.
+  * @retval: Length of UID, or -1 if error.
+  */
+int PN532_ReadPassiveTargetInfo(
+    PN532* pn532,
+    PN532_Target* target,
+    uint8_t card_baud,
+    uint32_t timeout
 ) {
     // Send passive read command for 1 card.  Expect at most a 7 byte UUID.
     uint8_t params[] = {0x01, card_baud};
-    uint8_t buff[19];
+    uint8_t buff[7 + MIFARE_UID_MAX_LENGTH + PN532_ATS_MAX_LENGTH];
     int length = PN532_CallFunction(pn532, PN532_COMMAND_INLISTPASSIVETARGET,
                         buff, sizeof(buff), params, sizeof(params), timeout);
     if (length < 0) {
         return PN532_STATUS_ERROR; // No card found
     }
     pn532->trace("ANSW", buff, length);
-    // Check only 1 card with up to a 7 byte UID is present.
+    // With limited passive activation retries an empty field is a valid answer.
+    if (length < 1 || buff[0] == 0x00) {
+        return PN532_STATUS_ERROR;
+    }
+    // Check only 1 card is present.
     if (buff[0] != 0x01) {
         pn532->log("More than one card detected!");
         return PN532_STATUS_ERROR;
     }
-    if (buff[5] > 7) {
-        pn532->log("Found card with unexpectedly long UID!");
+    if (PN532_ParseTargetA(pn532, buff + 1, length - 1, target) != PN532_STATUS_OK) {
+        return PN532_STATUS_ERROR;
+    }
+    pn532->desfire_aid = 0;
+    return target->uid_length;
+}
+
+/**
+  * @brief: Poll every family in types (PN532_POLL_*) with one InAutoPoll.
+  *     The PN532 tries each family once, one PN532_POLL_PERIOD_MS period
+  *     apiece, and returns the first target found, so an empty field costs
+  *     one round-trip whatever the number of families.
+  * @param timeout: host timeout, at least PN532_POLL_PERIOD_MS per family.
+  * @retval: PN532_STATUS_OK or PN532_STATUS_ERROR if no target was found.
+  */
+int PN532_PollTargets(PN532* pn532, uint8_t types, PN532_AnyTarget* any, uint32_t timeout) {
+    static const uint8_t AUTOPOLL_TYPES[] = {
+        PN532_AUTOPOLL_GENERIC_106, PN532_AUTOPOLL_FELICA_212, PN532_AUTOPOLL_FELICA_424,
+        PN532_AUTOPOLL_ISO14443_4B, PN532_AUTOPOLL_JEWEL
+    };
+    uint8_t params[2 + sizeof(AUTOPOLL_TYPES)] = {0x01, 0x01};  // poll once, period 150ms
+    uint8_t buff[3 + 7 + MIFARE_UID_MAX_LENGTH + PN532_ATS_MAX_LENGTH];
+    uint8_t count = 2, *data = buff + 3;
+    PN532_Target* target = &any->target;
+    for (uint8_t i = 0; i < sizeof(AUTOPOLL_TYPES); i++) {
+        if (types & (1 << i)) {
+            params[count++] = AUTOPOLL_TYPES[i];
+        }
+    }
+    if (count == 2) {
+        return PN532_STATUS_ERROR;
+    }
+    int length = PN532_CallFunction(pn532, PN532_COMMAND_INAUTOPOLL,
+                                    buff, sizeof(buff), params, count, timeout);
+    if (length < 3 || buff[0] == 0x00) {
         return PN532_STATUS_ERROR;
     }
-    for (uint8_t i = 0; i < buff[5]; i++) {
-        response[i] = buff[6 + i];
+    pn532->trace("POLL", buff, length);
+    // NbTg, then Type, Ln and target data of each target, only the first is used
+    length = buff[2] < length - 3 ? buff[2] : length - 3;
+    memset(any, 0, sizeof(PN532_AnyTarget));
+    pn532->desfire_aid = 0;
+    PN532_InvalidateRegisters(pn532);
+    switch (buff[1]) {
+        case PN532_AUTOPOLL_GENERIC_106:
+        case PN532_AUTOPOLL_MIFARE:
+        case PN532_AUTOPOLL_ISO14443_4A:
+            any->kind = PN532_POLL_ISO14443A;
+            return PN532_ParseTargetA(pn532, data, length, target);
+        case PN532_AUTOPOLL_FELICA_212:
+        case PN532_AUTOPOLL_FELICA_424:
+            // Tg, POL_RES length, response code 01, IDm, PMm, [system code]
+            if (length < 3 + PN532_FELICA_IDM_LENGTH + PN532_FELICA_PMM_LENGTH) {
+                break;
+            }
+            any->kind = buff[1] == PN532_AUTOPOLL_FELICA_212 ? PN532_POLL_FELICA_212 : PN532_POLL_FELICA_424;
+            any->info.felica.baud = any->kind;
+            memcpy(any->info.felica.idm, data + 3, PN532_FELICA_IDM_LENGTH);
+            memcpy(any->info.felica.pmm, data + 3 + PN532_FELICA_IDM_LENGTH, PN532_FELICA_PMM_LENGTH);
+            if (length >= 5 + PN532_FELICA_IDM_LENGTH + PN532_FELICA_PMM_LENGTH) {
+                any->info.felica.system_code = (data[19] << 8) | data[20];
+            }
+            target->tg = data[0];
+            target->type = PN532_CARD_FELICA;
+            target->uid_length = PN532_FELICA_IDM_LENGTH;
+            memcpy(target->uid, any->info.felica.idm, PN532_FELICA_IDM_LENGTH);
+            return PN532_STATUS_OK;
+        case PN532_AUTOPOLL_ISO14443_4B:
+            // Tg, ATQB, ATTRIB_RES length, ATTRIB_RES
+            if (length < 2 + PN532_ATQB_LENGTH) {
+                break;
+            }
+            any->kind = PN532_POLL_ISO14443B;
+            memcpy(any->info.iso14443b.atqb, data + 1, PN532_ATQB_LENGTH);
+            if (data[1 + PN532_ATQB_LENGTH] <= PN532_ATS_MAX_LENGTH
+                && 2 + PN532_ATQB_LENGTH + data[1 + PN532_ATQB_LENGTH] <= length) {
+                any->info.iso14443b.attrib_res_length = data[1 + PN532_ATQB_LENGTH];
+                memcpy(any->info.iso14443b.attrib_res, data + 2 + PN532_ATQB_LENGTH,
+                       any->info.iso14443b.attrib_res_length);
+            }
+            target->tg = data[0];
+            target->type = PN532_CARD_ISO14443B;
+            target->uid_length = 4;     // PUPI
+            memcpy(target->uid, any->info.iso14443b.atqb + 1, 4);
+            return PN532_STATUS_OK;
+        case PN532_AUTOPOLL_JEWEL:
+            // Tg, SENS_RES, JEWELID
+            if (length < 3 + PN532_JEWEL_ID_LENGTH) {
+                break;
+            }
+            any->kind = PN532_POLL_JEWEL;
+            any->info.jewel.sens_res = (data[1] << 8) | data[2];
+            memcpy(any->info.jewel.id, data + 3, PN532_JEWEL_ID_LENGTH);
+            target->tg = data[0];
+            target->type = PN532_CARD_JEWEL;
+            target->atqa = any->info.jewel.sens_res;
+            target->uid_length = PN532_JEWEL_ID_LENGTH;
+            memcpy(target->uid, any->info.jewel.id, PN532_JEWEL_ID_LENGTH);
+            return PN532_STATUS_OK;
+        default:
+            break;
+    }
+    pn532->log("Found target of unexpected type or length!");
+    return PN532_STATUS_ERROR;
+}
+
+/**
+  * @brief: Re-activate a target found by InListPassiveTarget without a new
+  *     anticollision loop (InSelect). MIFARE Classic cards halted by a failed
+  *     auth or read are woken up and selected by their known UID.
+  * @retval: PN532 error code.
+  */
+int PN532_SelectTarget(PN532* pn532, uint8_t tg) {
+    uint8_t response[1];
+    // RATS after the selection starts the card application from scratch
+    pn532->desfire_aid = 0;
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_INSELECT, response, sizeof(response),
+                                 &tg, 1, PN532_PRESENCE_TIMEOUT);
+    if (ret < 1) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    return response[0] & PN532_STATUS_ERROR_MASK;
+}
+
+/**
+  * @brief: Check the target is still in the field. ISO14443-4 targets answer
+  *     the Diagnose attention request test without losing their state, other
+  *     targets are re-activated with InSelect, which ends a MIFARE Classic
+  *     authenticated session.
+  * @retval: PN532_ERROR_NONE if present, PN532 error code otherwise.
+  */
+int PN532_CheckPresence(PN532* pn532, PN532_Target* target) {
+    if (target->type == PN532_CARD_FELICA) {
+        // Polling for any system code, answered by every FeliCa card
+        uint8_t polling[] = {6, PN532_FELICA_CMD_POLLING, 0xFF, 0xFF, 0x00, 0x00};
+        uint8_t answer[2 + PN532_FELICA_IDM_LENGTH + PN532_FELICA_PMM_LENGTH];
+        uint16_t received;
+        return PN532_InDataExchange(pn532, target->tg, polling, sizeof(polling),
+                                    answer, sizeof(answer), &received);
+    }
+    if (!(target->sak & PN532_SAK_ISO14443_4) && target->type != PN532_CARD_ISO14443B) {
+        return PN532_SelectTarget(pn532, target->tg);
+    }
+    uint8_t params[] = {PN532_DIAGNOSE_ATTENTION};
+    uint8_t response[1];
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_DIAGNOSE, response, sizeof(response),
+                                 params, sizeof(params), PN532_PRESENCE_TIMEOUT);
+    if (ret < 1) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    return response[0] & PN532_STATUS_ERROR_MASK;
+}
+
+/**
+  * @brief: Decode card type from ATQA and SAK as described in NXP AN10833.
+  *     ISO14443-4 cards are told apart by ATQA and ATS historical bytes.
+  * @retval: PN532_CARD_* value.
+  */
+uint8_t PN532_CardType(uint16_t atqa, uint8_t sak, uint8_t* ats, uint8_t ats_length) {
+    switch (sak) {
+        case 0x09:
+            return PN532_CARD_MIFARE_MINI;
+        case 0x08:
+        case 0x28:
+        case 0x88:
+            return PN532_CARD_MIFARE_1K;
+        case 0x19:
+            return PN532_CARD_MIFARE_2K;
+        case 0x18:
+        case 0x38:
+            return PN532_CARD_MIFARE_4K;
+        case 0x00:
+            return PN532_CARD_MIFARE_ULTRALIGHT;
+        case 0x10:
+        case 0x11:
+            return PN532_CARD_MIFARE_PLUS;
+        case 0x20:
+            if (atqa == 0x0344) {
+                return PN532_CARD_MIFARE_DESFIRE;
+            }
+            // MIFARE Plus SL3 carries C1 05 in the ATS historical bytes.
+            for (uint8_t i = 1; i + 1 < ats_length; i++) {
+                if (ats[i] == 0xC1 && ats[i + 1] == 0x05) {
+                    return PN532_CARD_MIFARE_PLUS;
+                }
+            }
+            return PN532_CARD_ISO14443_4;
+        default:
+            break;
+    }
+    return PN532_CARD_UNKNOWN;
+}
+
+/**
+  * @brief: Human readable name of PN532_CARD_* value.
+  */
+const char* PN532_CardTypeName(uint8_t type) {
+    switch (type) {
+        case PN532_CARD_MIFARE_MINI:        return "MIFARE Mini";
+        case PN532_CARD_MIFARE_1K:          return "MIFARE Classic 1K";
+        case PN532_CARD_MIFARE_2K:          return "MIFARE Classic 2K";
+        case PN532_CARD_MIFARE_4K:          return "MIFARE Classic 4K";
+        case PN532_CARD_MIFARE_ULTRALIGHT:  return "MIFARE Ultralight/NTAG";
+        case PN532_CARD_MIFARE_PLUS:        return "MIFARE Plus";
+        case PN532_CARD_MIFARE_DESFIRE:     return "MIFARE DESFire";
+        case PN532_CARD_ISO14443_4:         return "ISO14443-4";
+        case PN532_CARD_FELICA:             return "FeliCa";
+        case PN532_CARD_ISO14443B:          return "ISO14443B";
+        case PN532_CARD_JEWEL:              return "Jewel/Topaz";
+        default:                            return "Unknown";
     }
-    return buff[5];
 }
 
 /**
@@ -305,7 +1001,7 @@ int PN532_MifareClassicAuthenticateBlock(
   */
 int PN532_MifareClassicReadBlock(PN532* pn532, uint8_t* response, uint16_t block_number) {
     uint8_t params[] = {0x01, MIFARE_CMD_READ, block_number & 0xFF};
-    uint8_t buff[MIFARE_BLOCK_LENGTH + 1];
+    uint8_t buff[MIFARE_BLOCK_LENGTH + 1] = {PN532_ERROR_TIMEOUT};
     // Send InDataExchange request to read block of MiFare data.
     PN532_CallFunction(pn532, PN532_COMMAND_INDATAEXCHANGE, buff, sizeof(buff),
                        params, sizeof(params), PN532_DEFAULT_TIMEOUT);
@@ -367,6 +1063,36 @@ int PN532_Ntag2xxReadBlock(PN532* pn532, uint8_t* response, uint16_t block_numbe
     return buff[0];
 }
 
+/**
+  * @brief: Load a value block into the card transfer buffer with increment,
+  *     decrement or restore (MIFARE_CMD_STORE). The PN532 sends the command
+  *     and the operand as the two steps MIFARE expects.
+  * @param operand: amount to add or subtract, ignored by restore.
+  * @retval: PN532 error code.
+  */
+int PN532_MifareClassicValueOperation(PN532* pn532, uint8_t command, uint16_t block_number, uint32_t operand) {
+    uint8_t params[] = {
+        0x01, command, block_number & 0xFF,
+        operand & 0xFF, (operand >> 8) & 0xFF, (operand >> 16) & 0xFF, operand >> 24
+    };
+    uint8_t response[1] = {PN532_ERROR_TIMEOUT};
+    PN532_CallFunction(pn532, PN532_COMMAND_INDATAEXCHANGE, response,
+                       sizeof(response), params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    return response[0];
+}
+
+/**
+  * @brief: Write the card transfer buffer to a value block.
+  * @retval: PN532 error code.
+  */
+int PN532_MifareClassicTransfer(PN532* pn532, uint16_t block_number) {
+    uint8_t params[] = {0x01, MIFARE_CMD_TRANSFER, block_number & 0xFF};
+    uint8_t response[1] = {PN532_ERROR_TIMEOUT};
+    PN532_CallFunction(pn532, PN532_COMMAND_INDATAEXCHANGE, response,
+                       sizeof(response), params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    return response[0];
+}
+
 /**
   * @brief: Write a block of data to the card.  Block number should be the block
   *     to write and data should be a byte array of length 4 with the data to
@@ -389,6 +1115,439 @@ int PN532_Ntag2xxWriteBlock(PN532* pn532, uint8_t* data, uint16_t block_number)
     return response[0];
 }
 
+/**
+  * @brief: NTAG21x/Ultralight EV1 GET_VERSION, sent raw with InCommunicateThru.
+  *     Tags without it NAK and have to be selected again.
+  * @param version: 8 bytes, vendor ID, product type, subtype, version, storage size, protocol.
+  * @retval: PN532 error code.
+  */
+int PN532_Ntag2xxGetVersion(PN532* pn532, uint8_t* version) {
+    uint8_t params[] = {NTAG2XX_CMD_GET_VERSION};
+    uint8_t buff[NTAG2XX_VERSION_LENGTH + 1];
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_INCOMMUNICATETHRU, buff, sizeof(buff),
+                                 params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    if (ret < 1) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    if (buff[0] & PN532_STATUS_ERROR_MASK) {
+        return buff[0] & PN532_STATUS_ERROR_MASK;
+    }
+    if (ret != sizeof(buff)) {
+        return PN532_ERROR_RFPROTO;
+    }
+    memcpy(version, buff + 1, NTAG2XX_VERSION_LENGTH);
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Read pages start_page ... end_page with one FAST_READ, at most
+  *     NTAG2XX_FAST_READ_MAX_PAGES pages.
+  * @retval: PN532 error code.
+  */
+int PN532_Ntag2xxFastRead(PN532* pn532, uint8_t* response, uint8_t start_page, uint8_t end_page) {
+    uint8_t params[] = {NTAG2XX_CMD_FAST_READ, start_page, end_page};
+    uint8_t buff[NTAG2XX_FAST_READ_MAX_PAGES * NTAG2XX_BLOCK_LENGTH + 1];
+    uint16_t length = (end_page - start_page + 1) * NTAG2XX_BLOCK_LENGTH;
+    if (end_page < start_page || end_page - start_page >= NTAG2XX_FAST_READ_MAX_PAGES) {
+        return PN532_ERROR_INVAL;
+    }
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_INCOMMUNICATETHRU, buff, length + 1,
+                                 params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    if (ret < 1) {
+        return PN532_ERROR_TIMEOUT;
+    }
+    if (buff[0] & PN532_STATUS_ERROR_MASK) {
+        return buff[0] & PN532_STATUS_ERROR_MASK;
+    }
+    if (ret != length + 1) {
+        return PN532_ERROR_RFPROTO;
+    }
+    memcpy(response, buff + 1, length);
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Exchange data with an ISO14443-4 target of any length. Commands
+  *     longer than one frame are sent in chunks with MI set in Tg, the PN532
+  *     chains them to the card. Responses with MI set in the status are
+  *     continued with InDataExchange carrying Tg only.
+  * @param size: size of response.
+  * @param received: response length.
+  * @retval: PN532 error code, PN532_ERROR_TIMEOUT if a call failed,
+  *     PN532_ERROR_NOBUFS if the response does not fit.
+  */
+int PN532_InDataExchange(PN532* pn532, uint8_t tg, const uint8_t* data, uint16_t length,
+                         uint8_t* response, uint16_t size, uint16_t* received) {
+    uint8_t params[PN532_DATA_CHUNK_LENGTH + 1];
+    uint8_t buff[PN532_DATA_CHUNK_LENGTH + 1];
+    uint16_t chunk;
+    int ret;
+    *received = 0;
+    do {
+        chunk = length > PN532_DATA_CHUNK_LENGTH ? PN532_DATA_CHUNK_LENGTH : length;
+        params[0] = tg | (length > chunk ? PN532_MI : 0);
+        memcpy(params + 1, data, chunk);
+        data += chunk;
+        length -= chunk;
+        ret = PN532_CallFunction(pn532, PN532_COMMAND_INDATAEXCHANGE, buff, sizeof(buff),
+                                 params, chunk + 1, PN532_DEFAULT_TIMEOUT);
+        if (ret < 1) {
+            return PN532_ERROR_TIMEOUT;
+        }
+        if (buff[0] & PN532_STATUS_ERROR_MASK) {
+            return buff[0] & PN532_STATUS_ERROR_MASK;
+        }
+    } while (length);
+    for (;;) {
+        if (*received + ret - 1 > size) {
+            return PN532_ERROR_NOBUFS;
+        }
+        memcpy(response + *received, buff + 1, ret - 1);
+        *received += ret - 1;
+        if (!(buff[0] & PN532_MI)) {
+            return PN532_ERROR_NONE;
+        }
+        params[0] = tg;
+        ret = PN532_CallFunction(pn532, PN532_COMMAND_INDATAEXCHANGE, buff, sizeof(buff),
+                                 params, 1, PN532_DEFAULT_TIMEOUT);
+        if (ret < 1) {
+            return PN532_ERROR_TIMEOUT;
+        }
+        if (buff[0] & PN532_STATUS_ERROR_MASK) {
+            return buff[0] & PN532_STATUS_ERROR_MASK;
+        }
+    }
+}
+
+/**
+  * @brief: DESFire commands which return their data in frames, continued
+  *     with empty additional frames. Authentication and write commands also
+  *     answer 91AF, but expect data from the host.
+  */
+static bool PN532_DesfireChained(const uint8_t* command, uint16_t length) {
+    if (length < 2 || command[0] != DESFIRE_CLA) {
+        return false;
+    }
+    switch (command[1]) {
+        case DESFIRE_CMD_GET_VERSION:
+        case DESFIRE_CMD_GET_APPLICATION_IDS:
+        case DESFIRE_CMD_GET_DF_NAMES:
+        case DESFIRE_CMD_GET_FILE_IDS:
+        case DESFIRE_CMD_GET_ISO_FILE_IDS:
+        case DESFIRE_CMD_READ_DATA:
+        case DESFIRE_CMD_READ_RECORDS:
+            return true;
+    }
+    return false;
+}
+
+/**
+  * @brief: Send an APDU and collect the whole response at offset of the
+  *     reader APDU buffer, following 61xx with GET RESPONSE and 91AF of
+  *     DESFire read commands with additional frames.
+  */
+static int PN532_ApduAt(PN532* pn532, uint8_t tg, PN532_Apdu* apdu, uint16_t offset) {
+    const uint8_t* command = apdu->command;
+    uint16_t length = apdu->length, received, total = 0;
+    uint8_t more[5] = {0x00, ISO7816_INS_GET_RESPONSE, 0x00, 0x00, 0x00};
+    bool chained = PN532_DesfireChained(command, length);
+    int ret;
+    apdu->response = pn532->apdu + offset;
+    apdu->response_length = 0;
+    apdu->sw = 0;
+    for (uint8_t i = 0; i <= PN532_APDU_CHAIN_MAX; i++) {
+        ret = PN532_InDataExchange(pn532, tg, command, length, apdu->response + total,
+                                   PN532_APDU_BUFFER_LENGTH - offset - total, &received);
+        if (ret != PN532_ERROR_NONE) {
+            return ret;
+        }
+        if (received < 2) {
+            return PN532_ERROR_RFPROTO;
+        }
+        received -= 2;
+        apdu->sw = (apdu->response[total + received] << 8) | apdu->response[total + received + 1];
+        total += received;
+        apdu->response_length = total;
+        if ((apdu->sw >> 8) == ISO7816_SW1_MORE) {
+            more[0] = 0x00;
+            more[1] = ISO7816_INS_GET_RESPONSE;
+            more[4] = apdu->sw & 0xFF;
+        } else if (apdu->sw == DESFIRE_SW_MORE && chained) {
+            more[0] = DESFIRE_CLA;
+            more[1] = DESFIRE_CMD_ADDITIONAL_FRAME;
+            more[4] = 0x00;
+        } else {
+            break;
+        }
+        command = more;
+        length = sizeof(more);
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Send APDUs one after another, responses are stored back to back
+  *     in the reader APDU buffer. The batch stops at the first status word
+  *     other than 9000 or 9100, later APDUs are left with sw 0.
+  * @retval: PN532 error code or PN532_ERROR_APDU_STATUS.
+  */
+int PN532_ApduBatch(PN532* pn532, uint8_t tg, PN532_Apdu* apdus, uint8_t count) {
+    uint16_t offset = 0;
+    int ret;
+    for (uint8_t i = 0; i < count; i++) {
+        apdus[i].sw = 0;
+        apdus[i].response_length = 0;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        ret = PN532_ApduAt(pn532, tg, apdus + i, offset);
+        if (ret != PN532_ERROR_NONE) {
+            pn532->desfire_aid = 0;
+            return ret;
+        }
+        if (apdus[i].sw != ISO7816_SW_OK && apdus[i].sw != DESFIRE_SW_OK) {
+            pn532->desfire_aid = 0;
+            return PN532_ERROR_APDU_STATUS;
+        }
+        offset += apdus[i].response_length;
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: Send one APDU.
+  * @retval: PN532 error code or PN532_ERROR_APDU_STATUS.
+  */
+int PN532_ApduExchange(PN532* pn532, uint8_t tg, PN532_Apdu* apdu) {
+    return PN532_ApduBatch(pn532, tg, apdu, 1);
+}
+
+/**
+  * @brief: Read a DESFire standard or backup data file. SelectApplication is
+  *     skipped when the application is still selected, ReadData continues
+  *     with additional frames inside the same call.
+  * @param aid: 3-byte application ID, LSB first.
+  * @param length: bytes to read, 0 - up to the end of the file.
+  * @param data: points into the reader APDU buffer.
+  * @retval: PN532 error code or PN532_ERROR_APDU_STATUS.
+  */
+int PN532_DesfireReadFile(PN532* pn532, uint8_t tg, const uint8_t* aid, uint8_t file_number,
+                          uint32_t offset, uint32_t length, uint8_t** data, uint16_t* data_length) {
+    uint8_t select[] = {DESFIRE_CLA, DESFIRE_CMD_SELECT_APPLICATION, 0x00, 0x00, DESFIRE_AID_LENGTH,
+                        aid[0], aid[1], aid[2], 0x00};
+    uint8_t read[] = {DESFIRE_CLA, DESFIRE_CMD_READ_DATA, 0x00, 0x00, 0x07, file_number,
+                      offset & 0xFF, (offset >> 8) & 0xFF, (offset >> 16) & 0xFF,
+                      length & 0xFF, (length >> 8) & 0xFF, (length >> 16) & 0xFF, 0x00};
+    uint32_t selected = (aid[0] | (aid[1] << 8) | (aid[2] << 16)) + 1;
+    PN532_Apdu apdus[] = {
+        {select, sizeof(select), NULL, 0, 0},
+        {read, sizeof(read), NULL, 0, 0},
+    };
+    PN532_Apdu* first = pn532->desfire_aid == selected ? apdus + 1 : apdus;
+    uint8_t count = apdus + 2 - first;
+    int ret = PN532_ApduBatch(pn532, tg, first, count);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    pn532->desfire_aid = selected;
+    *data = apdus[1].response;
+    *data_length = apdus[1].response_length;
+    return PN532_ERROR_NONE;
+}
+
+/**
+  * @brief: FeliCa Read Without Encryption of count consecutive blocks of one service.
+  * @param target: FeliCa target, uid holds the IDm.
+  * @param data: count * PN532_FELICA_BLOCK_LENGTH bytes.
+  * @retval: PN532 error code or PN532_ERROR_FELICA_STATUS.
+  */
+int PN532_FelicaReadBlocks(PN532* pn532, PN532_Target* target, uint16_t service_code,
+                           uint16_t block_number, uint8_t count, uint8_t* data) {
+    uint8_t command[14 + 3 * PN532_FELICA_READ_MAX_BLOCKS];
+    uint8_t answer[13 + PN532_FELICA_BLOCK_LENGTH * PN532_FELICA_READ_MAX_BLOCKS];
+    uint8_t length = 0;
+    uint16_t received;
+    if (count == 0 || count > PN532_FELICA_READ_MAX_BLOCKS) {
+        return PN532_ERROR_INVAL;
+    }
+    // Length, command, IDm, one service (LSB first), block list
+    command[length++] = 0;
+    command[length++] = PN532_FELICA_CMD_READ;
+    memcpy(command + length, target->uid, PN532_FELICA_IDM_LENGTH);
+    length += PN532_FELICA_IDM_LENGTH;
+    command[length++] = 1;
+    command[length++] = service_code & 0xFF;
+    command[length++] = service_code >> 8;
+    command[length++] = count;
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t block = block_number + i;
+        if (block < 0x100) {
+            command[length++] = 0x80;   // 2-byte element, service 0
+            command[length++] = block;
+        } else {
+            command[length++] = 0x00;   // 3-byte element
+            command[length++] = block & 0xFF;
+            command[length++] = block >> 8;
+        }
+    }
+    command[0] = length;
+    int ret = PN532_InDataExchange(pn532, target->tg, command, length, answer, sizeof(answer), &received);
+    if (ret != PN532_ERROR_NONE) {
+        return ret;
+    }
+    // Length, response code, IDm, status flag 1 and 2, block count, blocks
+    if (received < 12 || answer[1] != PN532_FELICA_CMD_READ + 1) {
+        return PN532_ERROR_RFPROTO;
+    }
+    if (answer[10] != 0x00 || answer[11] != 0x00) {
+        return PN532_ERROR_FELICA_STATUS;
+    }
+    if (received < 13 + count * PN532_FELICA_BLOCK_LENGTH || answer[12] != count) {
+        return PN532_ERROR_RFPROTO;
+    }
+    memcpy(data, answer + 13, count * PN532_FELICA_BLOCK_LENGTH);
+    return PN532_ERROR_NONE;
+}
+
+static bool PN532_Shadowed(uint16_t address) {
+    return address >= PN532_CIU_BASE && address < PN532_CIU_BASE + PN532_CIU_SHADOW_SIZE
+           && (PN532_CIU_SHADOW_MASK & (1UL << (address - PN532_CIU_BASE)));
+}
+
+/**
+  * @brief: Read CIU/SFR registers with one ReadRegister command.
+  * @param registers: addresses to read, values are filled in.
+  * @retval: -1 if error
+  */
+int PN532_ReadRegisters(PN532* pn532, PN532_Register* registers, uint8_t count) {
+    uint8_t params[PN532_REGISTER_BATCH_MAX * 2];
+    uint8_t response[PN532_REGISTER_BATCH_MAX];
+    if (count == 0 || count > PN532_REGISTER_BATCH_MAX) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        params[i * 2] = registers[i].address >> 8;
+        params[i * 2 + 1] = registers[i].address & 0xFF;
+    }
+    if (PN532_CallFunction(pn532, PN532_COMMAND_READREGISTER, response, count,
+                           params, count * 2, PN532_DEFAULT_TIMEOUT) != count) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        registers[i].value = response[i];
+        if (PN532_Shadowed(registers[i].address)) {
+            pn532->ciu_shadow[registers[i].address - PN532_CIU_BASE] = response[i];
+            pn532->ciu_known |= 1UL << (registers[i].address - PN532_CIU_BASE);
+        }
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Write CIU/SFR registers with one WriteRegister command. Shadowed
+  *     registers already holding the value are dropped from the command,
+  *     nothing is sent when no register changes.
+  * @retval: -1 if error
+  */
+int PN532_WriteRegisters(PN532* pn532, const PN532_Register* registers, uint8_t count) {
+    uint8_t params[PN532_REGISTER_BATCH_MAX * 3];
+    uint16_t length = 0;
+    if (count > PN532_REGISTER_BATCH_MAX) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t address = registers[i].address;
+        if (PN532_Shadowed(address)
+            && (pn532->ciu_known & (1UL << (address - PN532_CIU_BASE)))
+            && pn532->ciu_shadow[address - PN532_CIU_BASE] == registers[i].value) {
+            pn532->registers_skipped++;
+            continue;
+        }
+        params[length++] = address >> 8;
+        params[length++] = address & 0xFF;
+        params[length++] = registers[i].value;
+    }
+    if (length == 0) {
+        return PN532_STATUS_OK;
+    }
+    if (PN532_CallFunction(pn532, PN532_COMMAND_WRITEREGISTER, NULL, 0,
+                           params, length, PN532_DEFAULT_TIMEOUT) < 0) {
+        PN532_InvalidateRegisters(pn532);
+        return PN532_STATUS_ERROR;
+    }
+    for (uint16_t i = 0; i < length; i += 3) {
+        uint16_t address = (params[i] << 8) | params[i + 1];
+        if (PN532_Shadowed(address)) {
+            pn532->ciu_shadow[address - PN532_CIU_BASE] = params[i + 2];
+            pn532->ciu_known |= 1UL << (address - PN532_CIU_BASE);
+        }
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Forget shadowed register values, e.g. after the firmware reloaded them.
+  */
+void PN532_InvalidateRegisters(PN532* pn532) {
+    pn532->ciu_known = 0;
+}
+
+static const PN532_Register PN532_PROFILE_DEFAULT[] = {
+    {PN532_CIU_RFCFG, 0x59}, {PN532_CIU_GSNON, 0xF4}, {PN532_CIU_CWGSP, 0x3F},
+    {PN532_CIU_MODGSP, 0x11}, {PN532_CIU_RXTHRESHOLD, 0x85}, {PN532_CIU_GSNOFF, 0x6F},
+};
+
+// Receiver gain 48 dB and a lower minimum signal level for far or weak cards
+static const PN532_Register PN532_PROFILE_HIGH_GAIN[] = {
+    {PN532_CIU_RFCFG, 0x79}, {PN532_CIU_GSNON, 0xF4}, {PN532_CIU_CWGSP, 0x3F},
+    {PN532_CIU_MODGSP, 0x11}, {PN532_CIU_RXTHRESHOLD, 0x55}, {PN532_CIU_GSNOFF, 0x6F},
+};
+
+// Lower carrier conductance, less field strength and supply current
+static const PN532_Register PN532_PROFILE_LOW_POWER[] = {
+    {PN532_CIU_RFCFG, 0x59}, {PN532_CIU_GSNON, 0x84}, {PN532_CIU_CWGSP, 0x1F},
+    {PN532_CIU_MODGSP, 0x08}, {PN532_CIU_RXTHRESHOLD, 0x85}, {PN532_CIU_GSNOFF, 0x6F},
+};
+
+#define PN532_PROFILE(name, regs) {name, regs, sizeof(regs) / sizeof(regs[0])}
+
+static const PN532_AnalogProfile PN532_AnalogProfiles[] = {
+    PN532_PROFILE("default", PN532_PROFILE_DEFAULT),
+    PN532_PROFILE("high-gain", PN532_PROFILE_HIGH_GAIN),
+    PN532_PROFILE("low-power", PN532_PROFILE_LOW_POWER),
+};
+
+/**
+  * @brief: Look up a built-in analog tuning profile by name.
+  * @retval: Profile, or NULL if unknown.
+  */
+const PN532_AnalogProfile* PN532_FindAnalogProfile(const char* name) {
+    for (uint8_t i = 0; i < sizeof(PN532_AnalogProfiles) / sizeof(PN532_AnalogProfiles[0]); i++) {
+        if (strcmp(PN532_AnalogProfiles[i].name, name) == 0) {
+            return &PN532_AnalogProfiles[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief: Enumerate built-in analog tuning profiles.
+  * @retval: Profile, or NULL past the last one.
+  */
+const PN532_AnalogProfile* PN532_AnalogProfileAt(uint8_t index) {
+    if (index >= sizeof(PN532_AnalogProfiles) / sizeof(PN532_AnalogProfiles[0])) {
+        return NULL;
+    }
+    return &PN532_AnalogProfiles[index];
+}
+
+/**
+  * @brief: Write all registers of a profile in one round-trip.
+  * @retval: -1 if error
+  */
+int PN532_ApplyAnalogProfile(PN532* pn532, const PN532_AnalogProfile* profile) {
+    return PN532_WriteRegisters(pn532, profile->registers, profile->count);
+}
+
 /**
   * @brief: Read the GPIO states.
   * @param pin_state: pin state buffer (3 bytes) returned.
@@ -404,8 +1563,21 @@ int PN532_Ntag2xxWriteBlock(PN532* pn532, uint8_t* data, uint16_t block_number)
   * @retval: -1 if error
   */
 int PN532_ReadGpio(PN532* pn532, uint8_t* pins_state) {
-    return PN532_CallFunction(pn532, PN532_COMMAND_READGPIO, pins_state, 3,
-                              NULL, 0, PN532_DEFAULT_TIMEOUT);
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_READGPIO, pins_state, 3,
+                                 NULL, 0, PN532_DEFAULT_TIMEOUT);
+    if (ret < 3) {
+        return PN532_STATUS_ERROR;
+    }
+    // Staged pin changes win over the state read back
+    if (!(pn532->gpio.dirty & PN532_GPIO_P3)) {
+        pn532->gpio.p3 = pins_state[0];
+    }
+    if (!(pn532->gpio.dirty & PN532_GPIO_P7)) {
+        pn532->gpio.p7 = pins_state[1];
+    }
+    pn532->gpio.i = pins_state[2];
+    pn532->gpio.valid = true;
+    return ret;
 }
 /**
   * @brief: Read the GPIO state of specified pins in (P30 ... P35).
@@ -414,15 +1586,8 @@ int PN532_ReadGpio(PN532* pn532, uint8_t* pins_state) {
   */
 bool PN532_ReadGpioP(PN532* pn532, uint8_t pin_number) {
     uint8_t pins_state[3];
-    PN532_CallFunction(pn532, PN532_COMMAND_READGPIO, pins_state,
-                       sizeof(pins_state), NULL, 0, PN532_DEFAULT_TIMEOUT);
-    if ((pin_number >= 30) && (pin_number <= 37)) {
-        return (pins_state[0] >> (pin_number - 30)) & 1 ? true : false;
-    }
-    if ((pin_number >= 70) && (pin_number <= 77)) {
-        return (pins_state[1] >> (pin_number - 70)) & 1 ? true : false;
-    }
-    return false;
+    PN532_ReadGpio(pn532, pins_state);
+    return PN532_GpioGet(pn532, pin_number);
 }
 /**
   * @brief: Read the GPIO state of I0 or I1 pin.
@@ -431,10 +1596,9 @@ bool PN532_ReadGpioP(PN532* pn532, uint8_t pin_number) {
   */
 bool PN532_ReadGpioI(PN532* pn532, uint8_t pin_number) {
     uint8_t pins_state[3];
-    PN532_CallFunction(pn532, PN532_COMMAND_READGPIO, pins_state,
-                       sizeof(pins_state), NULL, 0, PN532_DEFAULT_TIMEOUT);
+    PN532_ReadGpio(pn532, pins_state);
     if (pin_number <= 7) {
-        return (pins_state[2] >> pin_number) & 1 ? true : false;
+        return (pn532->gpio.i >> pin_number) & 1 ? true : false;
     }
     return false;
 }
@@ -463,37 +1627,94 @@ int PN532_WriteGpio(PN532* pn532, uint8_t* pins_state) {
     // 0x80, the validation bit.
     params[0] = 0x80 | pins_state[0];
     params[1] = 0x80 | pins_state[1];
-    return PN532_CallFunction(pn532, PN532_COMMAND_WRITEGPIO, NULL, 0,
-                              params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    int ret = PN532_CallFunction(pn532, PN532_COMMAND_WRITEGPIO, NULL, 0,
+                                 params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    if (ret >= 0) {
+        pn532->gpio.p3 = pins_state[0] & PN532_GPIO_P3_MASK;
+        pn532->gpio.p7 = pins_state[1] & PN532_GPIO_P7_MASK;
+        pn532->gpio.dirty = 0;
+    }
+    return ret;
 }
 /**
-  * @brief: Write the specified pin with given states.
+  * @brief: Write the specified pin with given states. The port is read once
+  *     to fill the GPIO cache, later writes only send WRITEGPIO.
   * @param pin_number: specify the pin to write.
   * @param pin_state: specify the pin state. true for HIGH, false for LOW.
   * @retval: -1 if error
   */
 int PN532_WriteGpioP(PN532* pn532, uint8_t pin_number, bool pin_state) {
-    uint8_t pins_state[2];
-    uint8_t params[2];
-    if (PN532_ReadGpio(pn532, pins_state) == PN532_STATUS_ERROR) {
+    if (PN532_GpioSet(pn532, pin_number, pin_state) == PN532_STATUS_ERROR) {
         return PN532_STATUS_ERROR;
     }
+    return PN532_GpioFlush(pn532);
+}
+/**
+  * @brief: Pin state from the GPIO cache, no command is sent. Staged writes
+  *     are visible before they are flushed.
+  * @param pin_number: P30 ... P35, P71, P72.
+  * @retval: true if HIGH, false if LOW or unknown
+  */
+bool PN532_GpioGet(PN532* pn532, uint8_t pin_number) {
     if ((pin_number >= 30) && (pin_number <= 37)) {
-        if (pin_state) {
-            params[0] = 0x80 | pins_state[0] | 1 << (pin_number - 30);
-        } else {
-            params[0] = (0x80 | pins_state[0]) & ~(1 << (pin_number - 30));
-        }
-        params[1] = 0x00;   // leave p7 unchanged
+        return (pn532->gpio.p3 >> (pin_number - 30)) & 1 ? true : false;
     }
     if ((pin_number >= 70) && (pin_number <= 77)) {
-        if (pin_state) {
-            params[1] = 0x80 | pins_state[1] | 1 << (pin_number - 70);
-        } else {
-            params[1] = (0x80 | pins_state[1]) & ~(1 << (pin_number - 70));
-        }
-        params[0] = 0x00;   // leave p3 unchanged
+        return (pn532->gpio.p7 >> (pin_number - 70)) & 1 ? true : false;
+    }
+    return false;
+}
+/**
+  * @brief: Stage a pin change in the GPIO cache, PN532_GpioFlush writes all
+  *     staged changes with one WRITEGPIO. The ports are read only if the
+  *     cache is empty.
+  * @param pin_number: P30 ... P35, P71, P72.
+  * @retval: -1 if error
+  */
+int PN532_GpioSet(PN532* pn532, uint8_t pin_number, bool pin_state) {
+    uint8_t pins_state[3];
+    uint8_t* port;
+    uint8_t bit;
+    if ((pin_number >= 30) && (pin_number <= 37)) {
+        port = &pn532->gpio.p3;
+        bit = 1 << (pin_number - 30);
+    } else if ((pin_number >= 70) && (pin_number <= 77)) {
+        port = &pn532->gpio.p7;
+        bit = 1 << (pin_number - 70);
+    } else {
+        return PN532_STATUS_ERROR;
     }
-    return PN532_CallFunction(pn532, PN532_COMMAND_WRITEGPIO, NULL, 0,
-                              params, sizeof(params), PN532_DEFAULT_TIMEOUT);
+    if (!pn532->gpio.valid && PN532_ReadGpio(pn532, pins_state) == PN532_STATUS_ERROR) {
+        return PN532_STATUS_ERROR;
+    }
+    uint8_t value = pin_state ? (*port | bit) : (*port & ~bit);
+    if (value != *port) {
+        *port = value;
+        pn532->gpio.dirty |= port == &pn532->gpio.p3 ? PN532_GPIO_P3 : PN532_GPIO_P7;
+    }
+    return PN532_STATUS_OK;
+}
+/**
+  * @brief: Write staged pin changes of both ports with one WRITEGPIO, ports
+  *     without changes are not validated and keep their state.
+  * @retval: -1 if error
+  */
+int PN532_GpioFlush(PN532* pn532) {
+    uint8_t params[2] = {0x00, 0x00};
+    if (!pn532->gpio.dirty) {
+        return PN532_STATUS_OK;
+    }
+    if (pn532->gpio.dirty & PN532_GPIO_P3) {
+        params[0] = 0x80 | (pn532->gpio.p3 & PN532_GPIO_P3_MASK);
+    }
+    if (pn532->gpio.dirty & PN532_GPIO_P7) {
+        params[1] = 0x80 | (pn532->gpio.p7 & PN532_GPIO_P7_MASK);
+    }
+    if (PN532_CallFunction(pn532, PN532_COMMAND_WRITEGPIO, NULL, 0,
+                           params, sizeof(params), PN532_DEFAULT_TIMEOUT) < 0) {
+        pn532->gpio.valid = false;  // state of the pins is unknown now
+        return PN532_STATUS_ERROR;
+    }
+    pn532->gpio.dirty = 0;
+    return PN532_STATUS_OK;
 }
@@ -97,6 +97,23 @@ extern "C" {
 
 #define PN532_MIFARE_ISO14443A              (0x00)
 
+// Card types decoded from ATQA/SAK (NXP AN10833)
+#define PN532_CARD_UNKNOWN                  (0x00)
+#define PN532_CARD_MIFARE_MINI              (0x01)
+#define PN532_CARD_MIFARE_1K                (0x02)
+#define PN532_CARD_MIFARE_2K                (0x03)
+#define PN532_CARD_MIFARE_4K                (0x04)
+#define PN532_CARD_MIFARE_ULTRALIGHT        (0x05)  // also NTAG2xx
+#define PN532_CARD_MIFARE_PLUS              (0x06)
+#define PN532_CARD_MIFARE_DESFIRE           (0x07)
+#define PN532_CARD_ISO14443_4               (0x08)  // other T=CL cards
+#define PN532_CARD_FELICA                   (0x09)
+#define PN532_CARD_ISO14443B                (0x0A)
+#define PN532_CARD_JEWEL                    (0x0B)
+
+#define PN532_SAK_ISO14443_4                (0x20)
+#define PN532_ATS_MAX_LENGTH                (32)
+
 // Mifare Commands
 #define MIFARE_CMD_AUTH_A                   (0x60)
 #define MIFARE_CMD_AUTH_B                   (0x61)
@@ -116,7 +133,11 @@ extern "C" {
 #define MIFARE_BLOCK_LENGTH                 (16)
 
 // NTAG2xx Commands
+#define NTAG2XX_CMD_GET_VERSION             (0x60)
+#define NTAG2XX_CMD_FAST_READ               (0x3A)
 #define NTAG2XX_BLOCK_LENGTH                (4)
+#define NTAG2XX_VERSION_LENGTH              (8)
+#define NTAG2XX_FAST_READ_MAX_PAGES         (63)    // one InCommunicateThru response frame
 
 // Prefixes for NDEF Records (to identify record type)
 #define NDEF_URIPREFIX_NONE                 (0x00)
@@ -241,14 +262,326 @@ extern "C" {
 #define PN532_STATUS_ERROR                                              (-1)
 #define PN532_STATUS_OK                                                 (0)
 
+#define PN532_DIAGNOSE_COMMLINE             (0x00)
+#define PN532_ECHO_MAX_LENGTH               (64)
+#define PN532_DIAGNOSE_ATTENTION            (0x06)  // attention request / ISO14443-4 presence check
+#define PN532_PRESENCE_TIMEOUT              (100)
+#define PN532_STATUS_ERROR_MASK             (0x3F)  // error code bits of InDataExchange-like status
+
+// Link recovery limits
+#define PN532_NACK_RETRIES                  (3)
+#define PN532_RESEND_RETRIES                (2)
+#define PN532_WAKEUP_THRESHOLD              (3)
+#define PN532_BACKOFF_MS                    (2)
+
+/**
+  * Link recovery counters, one per recovery tier:
+  *     nacks    - corrupted responses re-requested with a NACK frame
+  *     resends  - commands sent again after a missing/bad ACK
+  *     wakeups  - wakeups issued after repeated failed calls
+  *     failures - calls that failed after all retries
+  */
+typedef struct _PN532_Recovery {
+    uint32_t nacks;
+    uint32_t resends;
+    uint32_t wakeups;
+    uint32_t failures;
+    uint8_t consecutive;    // failed calls in a row since the last success
+} PN532_Recovery;
+
+/**
+  * Target descriptor returned by InListPassiveTarget for ISO14443A.
+  * ats keeps the whole ATS starting with its length byte TL.
+  */
+typedef struct _PN532_Target {
+    uint8_t tg;
+    uint16_t atqa;
+    uint8_t sak;
+    uint8_t uid_length;
+    uint8_t uid[MIFARE_UID_MAX_LENGTH];
+    uint8_t ats_length;
+    uint8_t ats[PN532_ATS_MAX_LENGTH];
+    uint8_t type;           // PN532_CARD_*
+} PN532_Target;
+
+// Adaptive ready polling
+#define PN532_LATENCY_SLOTS                 (128)   // response models, one per command code
+#define PN532_LATENCY_WARMUP                (4)     // samples before sleeping ahead
+#define PN532_POLL_MAX_MS                   (8)     // longest pause between ready checks
+
+/**
+  * Online model of a command completion time: EWMA of the latency and of
+  * its absolute deviation, the PN532 is expected ready after mean - 2 * dev.
+  */
+typedef struct _PN532_Latency {
+    uint32_t mean_us;
+    uint32_t dev_us;
+    uint32_t samples;
+} PN532_Latency;
+
+// RFConfiguration items
+#define PN532_RFCFG_FIELD                   (0x01)
+#define PN532_RFCFG_TIMINGS                 (0x02)
+#define PN532_RFCFG_MAXRTYCOM               (0x04)
+#define PN532_RFCFG_MAXRETRIES              (0x05)
+#define PN532_RFCFG_ANALOG_106A             (0x0A)
+#define PN532_RFCFG_ANALOG_212_424          (0x0B)
+#define PN532_RFCFG_ANALOG_TYPEB            (0x0C)
+#define PN532_RFCFG_ANALOG_ISO14443_4       (0x0D)
+
+#define PN532_RF_FIELD_ON                   (0x01)
+#define PN532_RF_FIELD_AUTO_RFCA            (0x02)
+#define PN532_RF_RETRIES_INFINITE           (0xFF)
+
+// RFConfiguration timeout codes: 0 - none, n - 100us * 2^(n - 1)
+#define PN532_RF_TIMEOUT_NONE               (0x00)
+#define PN532_RF_TIMEOUT_100US              (0x01)
+#define PN532_RF_TIMEOUT_1MS                (0x05)  // 1.6ms
+#define PN532_RF_TIMEOUT_6MS                (0x07)  // 6.4ms
+#define PN532_RF_TIMEOUT_25MS               (0x09)  // 25.6ms
+#define PN532_RF_TIMEOUT_51MS               (0x0A)  // 51.2ms, default retry timeout
+#define PN532_RF_TIMEOUT_102MS              (0x0B)  // 102.4ms, default ATR_RES timeout
+#define PN532_RF_TIMEOUT_409MS              (0x0D)  // 409.6ms
+#define PN532_RF_TIMEOUT_3S                 (0x10)  // 3.28s
+
+// PowerDown WakeUpEnable sources. The RF level detector only reacts to an
+// external field (phone, another reader), passive cards can not wake the PN532.
+#define PN532_WAKE_INT0                     (0x01)
+#define PN532_WAKE_INT1                     (0x02)
+#define PN532_WAKE_RF                       (0x08)
+#define PN532_WAKE_HSU                      (0x10)
+#define PN532_WAKE_SPI                      (0x20)
+#define PN532_WAKE_GPIO                     (0x40)
+#define PN532_WAKE_I2C                      (0x80)
+#define PN532_WAKE_HOST                     (PN532_WAKE_HSU | PN532_WAKE_SPI | PN532_WAKE_I2C)
+
+#define PN532_ANALOG_106A_LENGTH            (11)
+#define PN532_ANALOG_212_424_LENGTH         (8)
+#define PN532_ANALOG_TYPEB_LENGTH           (3)
+#define PN532_ANALOG_ISO14443_4_LENGTH      (9)
+
+/**
+  * CIU register values for 106 kbps type A (CfgItem 0x0A), in the order
+  * the PN532 expects them. See PN532 user manual 7.3.1.
+  */
+typedef struct _PN532_Analog106A {
+    uint8_t rf_cfg;             // CIU_RFCfg, RxGain in bits 6:4
+    uint8_t gsn_on;             // CIU_GsNOn
+    uint8_t cw_gsp;             // CIU_CWGsP
+    uint8_t mod_gsp;            // CIU_ModGsP
+    uint8_t demod_own_rf;       // CIU_Demod when own RF is on
+    uint8_t rx_threshold;       // CIU_RxThreshold
+    uint8_t demod_not_own_rf;   // CIU_Demod when own RF is off
+    uint8_t gsn_off;            // CIU_GsNOff
+    uint8_t mod_width;          // CIU_ModWidth
+    uint8_t mif_nfc;            // CIU_MifNFC
+    uint8_t tx_bit_phase;       // CIU_TxBitPhase
+} PN532_Analog106A;
+
+/**
+  * Named RF tuning: timings, retry counts and optional type A analog settings.
+  * max_retries_passive counts additional InListPassiveTarget attempts,
+  * PN532_RF_RETRIES_INFINITE keeps the PN532 polling until the host gives up.
+  */
+typedef struct _PN532_RFPreset {
+    const char* name;
+    uint8_t atr_res_timeout;    // PN532_RF_TIMEOUT_*
+    uint8_t retry_timeout;      // PN532_RF_TIMEOUT_*
+    uint8_t max_retry_com;
+    uint8_t max_retries_atr;
+    uint8_t max_retries_psl;
+    uint8_t max_retries_passive;
+    const PN532_Analog106A* analog;     // NULL - keep current settings
+} PN532_RFPreset;
+
+extern const PN532_Analog106A PN532_ANALOG_106A_DEFAULT;
+
+// CIU registers
+#define PN532_CIU_BASE                      (0x6300)
+#define PN532_CIU_TXMODE                    (0x6302)
+#define PN532_CIU_RXMODE                    (0x6303)
+#define PN532_CIU_TXCONTROL                 (0x6304)
+#define PN532_CIU_RXTHRESHOLD               (0x6308)
+#define PN532_CIU_DEMOD                     (0x6309)
+#define PN532_CIU_MIFNFC                    (0x630C)
+#define PN532_CIU_GSNOFF                    (0x6313)
+#define PN532_CIU_MODWIDTH                  (0x6314)
+#define PN532_CIU_TXBITPHASE                (0x6315)
+#define PN532_CIU_RFCFG                     (0x6316)
+#define PN532_CIU_GSNON                     (0x6317)
+#define PN532_CIU_CWGSP                     (0x6318)
+#define PN532_CIU_MODGSP                    (0x6319)
+// Configuration and analog registers 0x6301 - 0x630F and 0x6313 - 0x631D are
+// shadowed. Status, FIFO, command, CRC result (0x6311, 0x6312) and timer
+// counter (0x631E, 0x631F) registers change on their own and are always accessed.
+#define PN532_CIU_SHADOW_SIZE               (32)
+#define PN532_CIU_SHADOW_MASK               (0x3FF8FFFEUL)  // bit per shadowed CIU_BASE offset
+#define PN532_REGISTER_BATCH_MAX            (64)
+
+typedef struct _PN532_Register {
+    uint16_t address;
+    uint8_t value;
+} PN532_Register;
+
+/**
+  * Named set of CIU register values written with one WriteRegister.
+  * The PN532 reloads its analog settings (RFConfiguration items 0x0A-0x0D)
+  * when it activates a target, a profile holds until the next activation.
+  */
+typedef struct _PN532_AnalogProfile {
+    const char* name;
+    const PN532_Register* registers;
+    uint8_t count;
+} PN532_AnalogProfile;
+
+// Target families polled in one InAutoPoll
+#define PN532_POLL_ISO14443A                (0x01)
+#define PN532_POLL_FELICA_212               (0x02)
+#define PN532_POLL_FELICA_424               (0x04)
+#define PN532_POLL_ISO14443B                (0x08)
+#define PN532_POLL_JEWEL                    (0x10)
+#define PN532_POLL_FELICA                   (PN532_POLL_FELICA_212 | PN532_POLL_FELICA_424)
+#define PN532_POLL_ALL                      (0x1F)
+#define PN532_POLL_PERIOD_MS                (150)   // InAutoPoll period unit, each family is polled once
+
+// InAutoPoll target types
+#define PN532_AUTOPOLL_GENERIC_106          (0x00)
+#define PN532_AUTOPOLL_JEWEL                (0x04)
+#define PN532_AUTOPOLL_MIFARE               (0x10)
+#define PN532_AUTOPOLL_FELICA_212           (0x11)
+#define PN532_AUTOPOLL_FELICA_424           (0x12)
+#define PN532_AUTOPOLL_ISO14443_4A          (0x20)
+#define PN532_AUTOPOLL_ISO14443_4B          (0x23)
+
+#define PN532_FELICA_IDM_LENGTH             (8)
+#define PN532_FELICA_PMM_LENGTH             (8)
+#define PN532_FELICA_CMD_POLLING            (0x00)
+#define PN532_FELICA_CMD_READ               (0x06)  // Read Without Encryption
+#define PN532_FELICA_BLOCK_LENGTH           (16)
+#define PN532_FELICA_READ_MAX_BLOCKS        (12)    // response fits one frame
+#define PN532_FELICA_SERVICE_RO             (0x000B)  // FeliCa Lite-S read-only service
+#define PN532_ERROR_FELICA_STATUS           (0x81)  // not a PN532 code: card status flags are not zero
+#define PN532_ATQB_LENGTH                   (12)
+#define PN532_JEWEL_ID_LENGTH               (4)
+
+typedef struct _PN532_FelicaTarget {
+    uint8_t idm[PN532_FELICA_IDM_LENGTH];
+    uint8_t pmm[PN532_FELICA_PMM_LENGTH];
+    uint16_t system_code;   // 0 - not returned
+    uint8_t baud;           // 212 or 424 kbps: PN532_POLL_FELICA_212/424
+} PN532_FelicaTarget;
+
+typedef struct _PN532_TypeBTarget {
+    uint8_t atqb[PN532_ATQB_LENGTH];        // 0x50, PUPI, application data, protocol info
+    uint8_t attrib_res_length;
+    uint8_t attrib_res[PN532_ATS_MAX_LENGTH];
+} PN532_TypeBTarget;
+
+typedef struct _PN532_JewelTarget {
+    uint16_t sens_res;
+    uint8_t id[PN532_JEWEL_ID_LENGTH];
+} PN532_JewelTarget;
+
+/**
+  * Target of any polled family, kind tells which one (PN532_POLL_*).
+  * target is filled for every family: Tg, card type and the family ID
+  * (UID, IDm, PUPI or Jewel ID) as uid, so UID based code works for all.
+  * info holds the family specific data of non ISO14443A targets.
+  */
+typedef struct _PN532_AnyTarget {
+    uint8_t kind;
+    PN532_Target target;
+    union {
+        PN532_FelicaTarget felica;
+        PN532_TypeBTarget iso14443b;
+        PN532_JewelTarget jewel;
+    } info;
+} PN532_AnyTarget;
+
+// ISO14443-4 APDU exchange
+#define PN532_MI                            (0x40)  // more information: in Tg of a chained command, in status of a chained response
+#define PN532_DATA_CHUNK_LENGTH             (252)   // InDataExchange data bytes per frame
+#define PN532_APDU_BUFFER_LENGTH            (1024)  // responses of one batch, kept per reader
+#define PN532_APDU_CHAIN_MAX                (32)    // GET RESPONSE / additional frame requests per APDU
+#define PN532_ERROR_APDU_STATUS             (0x80)  // not a PN532 code: card answered with an error status word
+
+#define ISO7816_SW_OK                       (0x9000)
+#define ISO7816_SW1_MORE                    (0x61)  // 61xx: xx bytes more for GET RESPONSE
+#define ISO7816_INS_GET_RESPONSE            (0xC0)
+
+// DESFire native commands wrapped in ISO7816 APDUs (CLA 0x90)
+#define DESFIRE_CLA                         (0x90)
+#define DESFIRE_SW_OK                       (0x9100)
+#define DESFIRE_SW_MORE                     (0x91AF)
+#define DESFIRE_CMD_GET_VERSION             (0x60)
+#define DESFIRE_CMD_GET_APPLICATION_IDS     (0x6A)
+#define DESFIRE_CMD_GET_DF_NAMES            (0x6D)
+#define DESFIRE_CMD_GET_FILE_IDS            (0x6F)
+#define DESFIRE_CMD_GET_ISO_FILE_IDS        (0x61)
+#define DESFIRE_CMD_SELECT_APPLICATION      (0x5A)
+#define DESFIRE_CMD_READ_DATA               (0xBD)
+#define DESFIRE_CMD_READ_RECORDS            (0xBB)
+#define DESFIRE_CMD_ADDITIONAL_FRAME        (0xAF)
+#define DESFIRE_AID_LENGTH                  (3)
+
+/**
+  * One command APDU of a batch. The response (without the status word) is
+  * left in the reader APDU buffer and stays valid until the next exchange.
+  */
+typedef struct _PN532_Apdu {
+    const uint8_t* command;
+    uint16_t length;
+    uint8_t* response;
+    uint16_t response_length;
+    uint16_t sw;            // 0 - not sent
+} PN532_Apdu;
+
+// GPIO cache
+#define PN532_GPIO_P3                       (0x01)
+#define PN532_GPIO_P7                       (0x02)
+#define PN532_GPIO_P3_MASK                  (0x3F)  // P30 ... P35
+#define PN532_GPIO_P7_MASK                  (0x06)  // P71, P72
+
+/**
+  * Last known P3/P7/I port state. Pin writes are staged here and sent with
+  * one WRITEGPIO for both ports, dirty marks ports with staged changes.
+  */
+typedef struct _PN532_Gpio {
+    uint8_t p3;
+    uint8_t p7;
+    uint8_t i;
+    uint8_t dirty;          // PN532_GPIO_P3 | PN532_GPIO_P7
+    bool valid;             // ports were read or written since start
+} PN532_Gpio;
+
 typedef struct _PN532 {
     int (*reset)(void);
     int (*read_data)(uint8_t* data, uint16_t count);
     int (*write_data)(uint8_t *data, uint16_t count);
     bool (*wait_ready)(uint32_t timeout);
     int (*wakeup)(void);
+    int (*resume)(void);            // leave power down within a few ms, NULL - use wakeup
     void (*log)(const char* log);
     void (*trace)(const char* cap, uint8_t *buf, uint8_t sz);
+    void (*delay)(unsigned int ms);
+    int (*set_clock)(uint32_t hz);  // NULL if transport clock is fixed
+    bool (*is_ready)(void);         // single ready check, NULL - use wait_ready
+    uint32_t (*micros)(void);
+    PN532_Recovery recovery;
+    bool fixed_polling;     // poll with transport wait_ready intervals
+    uint32_t polls;         // ready checks done by adaptive polling
+    PN532_Latency ack_latency;
+    PN532_Latency latency[PN532_LATENCY_SLOTS];
+    bool full_init;         // always reset and wake up the PN532 on init
+    bool fast_started;      // init found the PN532 awake and skipped reset/wakeup
+    uint32_t startup_ms;    // time spent in init
+    PN532_Gpio gpio;
+    uint8_t ciu_shadow[PN532_CIU_SHADOW_SIZE];
+    uint32_t ciu_known;     // bit per shadowed register holding the chip value
+    uint32_t registers_skipped;     // writes dropped as the shadow already matched
+    uint8_t apdu[PN532_APDU_BUFFER_LENGTH];
+    uint32_t desfire_aid;   // selected DESFire application + 1, 0 - unknown
+    bool powered_down;      // PowerDown accepted, no resume since
 } PN532;
 
 
@@ -256,18 +589,59 @@ int PN532_WriteFrame(PN532* pn532, uint8_t* data, uint16_t length);
 int PN532_ReadFrame(PN532* pn532, uint8_t* buff, uint16_t length);
 int PN532_CallFunction(PN532* pn532, uint8_t command, uint8_t* response, uint16_t response_length, uint8_t* params, uint16_t params_length, uint32_t timeout);
 int PN532_GetFirmwareVersion(PN532* pn532, uint8_t* version);
+int PN532_ProbeFirmwareVersion(PN532* pn532, uint8_t* version, uint32_t timeout);
+int PN532_EchoTest(PN532* pn532, uint8_t* data, uint8_t length);
+uint32_t PN532_CalibrateClock(PN532* pn532, const uint32_t* rates, uint8_t count, uint16_t burst);
 int PN532_SamConfiguration(PN532* pn532);
+int PN532_PowerDown(PN532* pn532, uint8_t wake_sources);
+int PN532_Resume(PN532* pn532);
+int PN532_RFConfiguration(PN532* pn532, uint8_t item, const uint8_t* data, uint8_t length);
+int PN532_SetRFField(PN532* pn532, bool on, bool auto_rfca);
+int PN532_SetRFTimings(PN532* pn532, uint8_t atr_res_timeout, uint8_t retry_timeout);
+int PN532_SetMaxRetryCom(PN532* pn532, uint8_t retries);
+int PN532_SetMaxRetries(PN532* pn532, uint8_t atr, uint8_t psl, uint8_t passive_activation);
+int PN532_SetAnalog106A(PN532* pn532, const PN532_Analog106A* analog);
+const PN532_RFPreset* PN532_FindRFPreset(const char* name);
+const PN532_RFPreset* PN532_RFPresetAt(uint8_t index);
+int PN532_ApplyRFPreset(PN532* pn532, const PN532_RFPreset* preset);
 int PN532_ReadPassiveTarget(PN532* pn532, uint8_t* response, uint8_t card_baud, uint32_t timeout);
+int PN532_ReadPassiveTargetInfo(PN532* pn532, PN532_Target* target, uint8_t card_baud, uint32_t timeout);
+int PN532_PollTargets(PN532* pn532, uint8_t types, PN532_AnyTarget* any, uint32_t timeout);
+int PN532_SelectTarget(PN532* pn532, uint8_t tg);
+int PN532_CheckPresence(PN532* pn532, PN532_Target* target);
+uint8_t PN532_CardType(uint16_t atqa, uint8_t sak, uint8_t* ats, uint8_t ats_length);
+const char* PN532_CardTypeName(uint8_t type);
 int PN532_MifareClassicAuthenticateBlock(PN532* pn532, uint8_t* uid, uint8_t uid_length, uint16_t block_number, uint16_t key_number, uint8_t* key);
 int PN532_MifareClassicReadBlock(PN532* pn532, uint8_t* response, uint16_t block_number);
 int PN532_MifareClassicWriteBlock(PN532* pn532, uint8_t* data, uint16_t block_number);
+int PN532_MifareClassicValueOperation(PN532* pn532, uint8_t command, uint16_t block_number, uint32_t operand);
+int PN532_MifareClassicTransfer(PN532* pn532, uint16_t block_number);
 int PN532_Ntag2xxReadBlock(PN532* pn532, uint8_t* response, uint16_t block_number);
 int PN532_Ntag2xxWriteBlock(PN532* pn532, uint8_t* data, uint16_t block_number);
+int PN532_Ntag2xxGetVersion(PN532* pn532, uint8_t* version);
+int PN532_Ntag2xxFastRead(PN532* pn532, uint8_t* response, uint8_t start_page, uint8_t end_page);
+int PN532_InDataExchange(PN532* pn532, uint8_t tg, const uint8_t* data, uint16_t length,
+                         uint8_t* response, uint16_t size, uint16_t* received);
+int PN532_ApduBatch(PN532* pn532, uint8_t tg, PN532_Apdu* apdus, uint8_t count);
+int PN532_ApduExchange(PN532* pn532, uint8_t tg, PN532_Apdu* apdu);
+int PN532_DesfireReadFile(PN532* pn532, uint8_t tg, const uint8_t* aid, uint8_t file_number,
+                          uint32_t offset, uint32_t length, uint8_t** data, uint16_t* data_length);
+int PN532_FelicaReadBlocks(PN532* pn532, PN532_Target* target, uint16_t service_code,
+                           uint16_t block_number, uint8_t count, uint8_t* data);
 int PN532_ReadGpio(PN532* pn532, uint8_t* pins_state);
 bool PN532_ReadGpioP(PN532* pn532, uint8_t pin_number);
 bool PN532_ReadGpioI(PN532* pn532, uint8_t pin_number);
 int PN532_WriteGpio(PN532* pn532, uint8_t* pins_state);
 int PN532_WriteGpioP(PN532* pn532, uint8_t pin_number, bool pin_state);
+int PN532_ReadRegisters(PN532* pn532, PN532_Register* registers, uint8_t count);
+int PN532_WriteRegisters(PN532* pn532, const PN532_Register* registers, uint8_t count);
+void PN532_InvalidateRegisters(PN532* pn532);
+const PN532_AnalogProfile* PN532_FindAnalogProfile(const char* name);
+const PN532_AnalogProfile* PN532_AnalogProfileAt(uint8_t index);
+int PN532_ApplyAnalogProfile(PN532* pn532, const PN532_AnalogProfile* profile);
+bool PN532_GpioGet(PN532* pn532, uint8_t pin_number);
+int PN532_GpioSet(PN532* pn532, uint8_t pin_number, bool pin_state);
+int PN532_GpioFlush(PN532* pn532);
 
 #ifdef __cplusplus
 }
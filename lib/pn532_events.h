@@ -0,0 +1,151 @@
+/**************************************************************************
+ *  @file     pn532_events.h
+ *  @license  BSD
+ *
+ *  Shared memory card event ring, header-only client.
+ *
+ *  The reader publishes every card event into a POSIX shared memory ring
+ *  of fixed-size records (single producer, any number of consumers).
+ *  Consumers map it read-only and read records with no syscall per event.
+ *  Each record carries a seqlock stamp: 2n+1 while record n is written,
+ *  2n+2 once it is complete. A consumer which falls more than
+ *  PN532_RING_SLOTS events behind loses the oldest ones and is told how
+ *  many it lost.
+ *
+ *      PN532_RingReader reader;
+ *      PN532_RingRecord record;
+ *      PN532_RingAttach(&reader, "/reader-events");
+ *      while (PN532_RingNext(&reader, &record) == 1) { ... }
+ **************************************************************************/
+
+#ifndef PN532_EVENTS_H
+#define PN532_EVENTS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PN532_RING_MAGIC                    (0x474E4952)    // "RING"
+#define PN532_RING_VERSION                  (1)
+#define PN532_RING_SLOTS                    (64)            // power of two
+#define PN532_RING_DATA_MAX                 (4096)
+#define PN532_RING_UID_MAX                  (10)
+
+// Record types, same as the event socket
+#define PN532_EVENT_ARRIVED                 (1)
+#define PN532_EVENT_DATA                    (2)
+#define PN532_EVENT_REMOVED                 (3)
+#define PN532_EVENT_ACCESS                  (4)
+
+typedef struct _PN532_RingRecord {
+    uint64_t stamp;             // seqlock, 2n+2 when record n is complete
+    uint64_t time_us;           // event time, CLOCK_REALTIME
+    uint64_t publish_us;        // time the record was written, CLOCK_MONOTONIC
+    uint32_t sequence;          // event number since the reader started
+    uint8_t type;               // PN532_EVENT_*
+    uint8_t card_type;          // PN532_CARD_*
+    uint8_t sak;
+    uint8_t uid_length;
+    uint16_t atqa;
+    uint16_t data_length;
+    uint8_t uid[PN532_RING_UID_MAX];
+    uint8_t reserved[18];
+    uint8_t data[PN532_RING_DATA_MAX];  // card image by block or page
+} PN532_RingRecord;
+
+typedef struct _PN532_RingHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slots;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t head;              // records published, written after the record
+    uint8_t pad[40];            // keeps records on their own cache lines
+    PN532_RingRecord records[PN532_RING_SLOTS];
+} PN532_RingHeader;
+
+typedef struct _PN532_RingReader {
+    const PN532_RingHeader* ring;
+    uint64_t next;              // next record to read
+    uint64_t lost;              // records overwritten before they were read
+} PN532_RingReader;
+
+/**
+  * @brief: Map the ring read-only, reading starts with the next event.
+  * @retval: 0 if attached, -1 if error.
+  */
+static inline int PN532_RingAttach(PN532_RingReader* reader, const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    memset(reader, 0, sizeof(*reader));
+    if (fd < 0) {
+        return -1;
+    }
+    void* map = mmap(NULL, sizeof(PN532_RingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    reader->ring = (const PN532_RingHeader*)map;
+    if (reader->ring->magic != PN532_RING_MAGIC || reader->ring->version != PN532_RING_VERSION
+        || reader->ring->slots != PN532_RING_SLOTS
+        || reader->ring->record_size != sizeof(PN532_RingRecord)) {
+        munmap(map, sizeof(PN532_RingHeader));
+        reader->ring = NULL;
+        return -1;
+    }
+    reader->next = __atomic_load_n(&reader->ring->head, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/**
+  * @brief: Copy the next record out of the ring.
+  * @retval: 1 if a record was read, 0 if there is no new record.
+  */
+static inline int PN532_RingNext(PN532_RingReader* reader, PN532_RingRecord* record) {
+    for (;;) {
+        uint64_t head = __atomic_load_n(&reader->ring->head, __ATOMIC_ACQUIRE);
+        if (reader->next >= head) {
+            return 0;
+        }
+        if (head - reader->next > PN532_RING_SLOTS) {
+            reader->lost += head - PN532_RING_SLOTS - reader->next;
+            reader->next = head - PN532_RING_SLOTS;
+        }
+        const PN532_RingRecord* slot = &reader->ring->records[reader->next & (PN532_RING_SLOTS - 1)];
+        uint64_t stamp = reader->next * 2 + 2;
+        if (__atomic_load_n(&slot->stamp, __ATOMIC_ACQUIRE) == stamp) {
+            memcpy(record, slot, sizeof(PN532_RingRecord) - PN532_RING_DATA_MAX);
+            memcpy(record->data, slot->data,
+                   slot->data_length <= PN532_RING_DATA_MAX ? slot->data_length : PN532_RING_DATA_MAX);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->stamp, __ATOMIC_RELAXED) == stamp
+                && record->data_length <= PN532_RING_DATA_MAX) {
+                reader->next++;
+                return 1;
+            }
+        }
+        // Overwritten while it was read
+        reader->lost++;
+        reader->next++;
+    }
+}
+
+static inline void PN532_RingDetach(PN532_RingReader* reader) {
+    if (reader->ring) {
+        munmap((void*)reader->ring, sizeof(PN532_RingHeader));
+        reader->ring = NULL;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* PN532_EVENTS_H */
@@ -0,0 +1,377 @@
+/**************************************************************************
+ *  @file     pn532_replay.c
+ *  @license  BSD
+ *
+ *  Record/replay transport for PN532, see pn532_replay.h.
+ *  Transport hooks take no context, so the recorder and the replay keep
+ *  their state in this file: one recording or replay at a time.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pn532_replay.h"
+
+static uint32_t replay_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+/**************************************************************************
+ * Recorder
+ **************************************************************************/
+static FILE* rec_file = NULL;
+static PN532 rec_inner;             // hooks of the recorded transport
+static uint32_t rec_last_us;        // time of the previous record
+static uint32_t rec_io_us;          // time of the last write or read
+static bool rec_waiting;            // the last write or read was not followed by ready yet
+
+static void rec_put(uint8_t op, uint32_t delta, int16_t value, const uint8_t* data, uint16_t length) {
+    uint8_t header[PN532_REPLAY_RECORD_HEADER];
+    header[0] = op;
+    for (uint8_t i = 0; i < 4; i++) {
+        header[1 + i] = (delta >> (i * 8)) & 0xFF;
+    }
+    header[5] = value & 0xFF;
+    header[6] = (value >> 8) & 0xFF;
+    header[7] = length & 0xFF;
+    header[8] = length >> 8;
+    fwrite(header, sizeof(header), 1, rec_file);
+    if (length) {
+        fwrite(data, length, 1, rec_file);
+    }
+}
+
+static void rec_event(uint8_t op, int16_t value, const uint8_t* data, uint16_t length) {
+    uint32_t now = replay_now_us();
+    rec_put(op, now - rec_last_us, value, data, length);
+    rec_last_us = now;
+}
+
+static void rec_ready(bool ready) {
+    if (!rec_waiting) {
+        return;
+    }
+    if (ready) {
+        rec_put(PN532_REPLAY_READY, replay_now_us() - rec_io_us, 0, NULL, 0);
+        rec_waiting = false;
+    }
+}
+
+static int rec_write_data(uint8_t* data, uint16_t count) {
+    int ret = rec_inner.write_data(data, count);
+    rec_event(PN532_REPLAY_WRITE, ret, data, count);
+    rec_io_us = rec_last_us;
+    rec_waiting = true;
+    return ret;
+}
+
+static int rec_read_data(uint8_t* data, uint16_t count) {
+    int ret = rec_inner.read_data(data, count);
+    rec_event(PN532_REPLAY_READ, ret, data, count);
+    rec_io_us = rec_last_us;
+    rec_waiting = true;
+    // One record per transaction reaches the file, a crash loses at most one
+    fflush(rec_file);
+    return ret;
+}
+
+static bool rec_wait_ready(uint32_t timeout) {
+    bool ready = rec_inner.wait_ready(timeout);
+    if (!ready && rec_waiting) {
+        rec_event(PN532_REPLAY_TIMEOUT, 0, NULL, 0);
+    }
+    rec_ready(ready);
+    return ready;
+}
+
+static bool rec_is_ready(void) {
+    bool ready = rec_inner.is_ready();
+    rec_ready(ready);
+    return ready;
+}
+
+static int rec_reset(void) {
+    rec_event(PN532_REPLAY_RESET, 0, NULL, 0);
+    return rec_inner.reset();
+}
+
+static int rec_wakeup(void) {
+    rec_event(PN532_REPLAY_WAKEUP, 0, NULL, 0);
+    return rec_inner.wakeup();
+}
+
+static int rec_resume(void) {
+    rec_event(PN532_REPLAY_WAKEUP, 0, NULL, 0);
+    return rec_inner.resume();
+}
+
+/**
+  * @brief: Start recording the traffic of the transport set up in pn532.
+  * @retval: PN532_STATUS_OK or PN532_STATUS_ERROR.
+  */
+int PN532_Record_Start(PN532* pn532, const char* path) {
+    uint8_t header[6] = {
+        PN532_REPLAY_MAGIC & 0xFF, (PN532_REPLAY_MAGIC >> 8) & 0xFF,
+        (PN532_REPLAY_MAGIC >> 16) & 0xFF, PN532_REPLAY_MAGIC >> 24,
+        PN532_REPLAY_VERSION, 0
+    };
+    if (rec_file) {
+        return PN532_STATUS_ERROR;
+    }
+    rec_file = fopen(path, "wb");
+    if (!rec_file) {
+        return PN532_STATUS_ERROR;
+    }
+    fwrite(header, sizeof(header), 1, rec_file);
+    rec_inner = *pn532;
+    rec_last_us = replay_now_us();
+    rec_waiting = false;
+    pn532->write_data = rec_write_data;
+    pn532->read_data = rec_read_data;
+    pn532->wait_ready = rec_wait_ready;
+    if (pn532->is_ready) {
+        pn532->is_ready = rec_is_ready;
+    }
+    if (pn532->reset) {
+        pn532->reset = rec_reset;
+    }
+    if (pn532->wakeup) {
+        pn532->wakeup = rec_wakeup;
+    }
+    if (pn532->resume) {
+        pn532->resume = rec_resume;
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Stop recording and give the transport its own hooks back.
+  */
+void PN532_Record_Stop(PN532* pn532) {
+    if (!rec_file) {
+        return;
+    }
+    fclose(rec_file);
+    rec_file = NULL;
+    pn532->write_data = rec_inner.write_data;
+    pn532->read_data = rec_inner.read_data;
+    pn532->wait_ready = rec_inner.wait_ready;
+    pn532->is_ready = rec_inner.is_ready;
+    pn532->reset = rec_inner.reset;
+    pn532->wakeup = rec_inner.wakeup;
+    pn532->resume = rec_inner.resume;
+}
+
+/**************************************************************************
+ * Replay
+ **************************************************************************/
+static uint8_t* rp_data = NULL;
+static uint32_t rp_size;
+static uint32_t rp_pos;
+static uint8_t rp_mode;
+static uint64_t rp_clock_us;        // virtual clock in fast mode
+static uint64_t rp_ready_at;        // when the PN532 becomes ready after the last write or read
+static PN532_ReplayStats rp_stats;
+
+typedef struct {
+    uint8_t op;
+    uint32_t delta;
+    int16_t value;
+    uint16_t length;
+    const uint8_t* payload;
+} rp_record;
+
+static uint64_t rp_now(void) {
+    return rp_mode == PN532_REPLAY_FAST ? rp_clock_us : replay_now_us();
+}
+
+static void rp_sleep_us(uint64_t us) {
+    if (rp_mode == PN532_REPLAY_FAST) {
+        rp_clock_us += us;
+    } else {
+        usleep(us);
+    }
+}
+
+static bool rp_peek(rp_record* record) {
+    const uint8_t* p = rp_data + rp_pos;
+    if (rp_pos + PN532_REPLAY_RECORD_HEADER > rp_size) {
+        return false;
+    }
+    record->op = p[0];
+    record->delta = p[1] | (p[2] << 8) | (p[3] << 16) | ((uint32_t)p[4] << 24);
+    record->value = (int16_t)(p[5] | (p[6] << 8));
+    record->length = p[7] | (p[8] << 8);
+    record->payload = p + PN532_REPLAY_RECORD_HEADER;
+    return rp_pos + PN532_REPLAY_RECORD_HEADER + record->length <= rp_size;
+}
+
+static void rp_next(const rp_record* record) {
+    rp_pos += PN532_REPLAY_RECORD_HEADER + record->length;
+    rp_stats.records++;
+}
+
+// Skip markers the caller doesn't consume (reset, wakeup, readiness never polled)
+static bool rp_expect(uint8_t op, rp_record* record) {
+    while (rp_peek(record)) {
+        if (record->op == op) {
+            return true;
+        }
+        if (record->op == PN532_REPLAY_WRITE || record->op == PN532_REPLAY_READ) {
+            rp_stats.underruns++;
+            return false;
+        }
+        rp_next(record);
+    }
+    rp_stats.underruns++;
+    return false;
+}
+
+// Readiness latency after this write or read, if the recording saw it
+static void rp_arm_ready(void) {
+    rp_record record;
+    rp_ready_at = rp_now();
+    if (rp_peek(&record) && record.op == PN532_REPLAY_READY) {
+        rp_ready_at += record.delta;
+    }
+}
+
+static int rp_write_data(uint8_t* data, uint16_t count) {
+    rp_record record;
+    if (!rp_expect(PN532_REPLAY_WRITE, &record)) {
+        return PN532_STATUS_ERROR;
+    }
+    if (record.length != count || memcmp(record.payload, data, count) != 0) {
+        rp_stats.mismatches++;
+    }
+    rp_next(&record);
+    rp_arm_ready();
+    return record.value;
+}
+
+static int rp_read_data(uint8_t* data, uint16_t count) {
+    rp_record record;
+    if (!rp_expect(PN532_REPLAY_READ, &record)) {
+        return PN532_STATUS_ERROR;
+    }
+    memcpy(data, record.payload, record.length < count ? record.length : count);
+    rp_next(&record);
+    rp_arm_ready();
+    return record.value;
+}
+
+static bool rp_is_ready(void) {
+    rp_record record;
+    if (!rp_peek(&record)) {
+        return false;
+    }
+    if (record.op == PN532_REPLAY_READ) {
+        return true;    // recorded without a readiness check
+    }
+    if (record.op != PN532_REPLAY_READY) {
+        return false;   // the recorded poll timed out
+    }
+    if (rp_now() < rp_ready_at) {
+        return false;
+    }
+    rp_next(&record);
+    return true;
+}
+
+static bool rp_wait_ready(uint32_t timeout) {
+    rp_record record;
+    uint64_t now = rp_now();
+    if (rp_peek(&record) && record.op == PN532_REPLAY_READ) {
+        return true;
+    }
+    if (rp_peek(&record) && record.op == PN532_REPLAY_READY
+        && rp_ready_at <= now + (uint64_t)timeout * 1000) {
+        if (rp_ready_at > now) {
+            rp_sleep_us(rp_ready_at - now);
+        }
+        rp_next(&record);
+        return true;
+    }
+    if (rp_peek(&record) && record.op == PN532_REPLAY_TIMEOUT) {
+        rp_next(&record);
+    }
+    rp_sleep_us((uint64_t)timeout * 1000);
+    return false;
+}
+
+static int rp_noop(void) {
+    return PN532_STATUS_OK;
+}
+
+static void rp_delay(unsigned int ms) {
+    rp_sleep_us((uint64_t)ms * 1000);
+}
+
+static uint32_t rp_micros(void) {
+    return (uint32_t)rp_now();
+}
+
+/**
+  * @brief: Set up pn532 to replay a recording instead of talking to hardware.
+  *     log and trace hooks are left as they are.
+  * @param mode: PN532_REPLAY_REALTIME or PN532_REPLAY_FAST.
+  * @retval: PN532_STATUS_OK or PN532_STATUS_ERROR.
+  */
+int PN532_Replay_Init(PN532* pn532, const char* path, uint8_t mode) {
+    FILE* f = fopen(path, "rb");
+    long size;
+    if (!f) {
+        return PN532_STATUS_ERROR;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    free(rp_data);
+    rp_data = size > 6 ? malloc(size) : NULL;
+    if (!rp_data || fread(rp_data, size, 1, f) != 1
+        || (rp_data[0] | (rp_data[1] << 8) | (rp_data[2] << 16) | ((uint32_t)rp_data[3] << 24)) != PN532_REPLAY_MAGIC
+        || rp_data[4] != PN532_REPLAY_VERSION) {
+        fclose(f);
+        free(rp_data);
+        rp_data = NULL;
+        return PN532_STATUS_ERROR;
+    }
+    fclose(f);
+    rp_size = size;
+    rp_pos = 6;
+    rp_mode = mode;
+    rp_clock_us = 0;
+    rp_ready_at = 0;
+    memset(&rp_stats, 0, sizeof(rp_stats));
+    pn532->reset = rp_noop;
+    pn532->wakeup = rp_noop;
+    pn532->resume = rp_noop;
+    pn532->read_data = rp_read_data;
+    pn532->write_data = rp_write_data;
+    pn532->wait_ready = rp_wait_ready;
+    pn532->is_ready = rp_is_ready;
+    pn532->delay = rp_delay;
+    pn532->micros = rp_micros;
+    pn532->set_clock = NULL;
+    return PN532_STATUS_OK;
+}
+
+/**
+  * @brief: Every recorded frame was served.
+  */
+bool PN532_Replay_Done(void) {
+    rp_record record;
+    while (rp_peek(&record) && record.op != PN532_REPLAY_WRITE && record.op != PN532_REPLAY_READ) {
+        rp_next(&record);
+    }
+    return !rp_data || rp_pos >= rp_size;
+}
+
+void PN532_Replay_Stats(PN532_ReplayStats* stats) {
+    *stats = rp_stats;
+    stats->virtual_us = rp_clock_us;
+}
@@ -0,0 +1,59 @@
+/**************************************************************************
+ *  @file     pn532_replay.h
+ *  @license  BSD
+ *
+ *  Header file for pn532_replay.c
+ *
+ *  Record/replay of PN532 transport traffic. The recorder wraps the hooks
+ *  of any transport and logs every frame written and read, with the time
+ *  since the previous record, and how long the PN532 took to become ready
+ *  after each write or read. The replay transport serves the recorded frames back
+ *  with the recorded ready latencies, either in real time or on a virtual
+ *  clock which only advances through pn532->delay, so a whole card session
+ *  replays as fast as the host code runs.
+ **************************************************************************/
+
+#ifndef PN532_REPLAY_H
+#define PN532_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PN532_REPLAY_MAGIC                  (0x594C5052)    // "RPLY"
+#define PN532_REPLAY_VERSION                (1)
+
+// Record: op (1), us since previous record (4), value (2), length (2), payload
+#define PN532_REPLAY_RECORD_HEADER          (9)
+#define PN532_REPLAY_WRITE                  (1)     // value - write_data result
+#define PN532_REPLAY_READ                   (2)     // value - read_data result
+#define PN532_REPLAY_READY                  (3)     // delta - us from the last write/read until ready
+#define PN532_REPLAY_TIMEOUT                (4)     // wait_ready gave up
+#define PN532_REPLAY_RESET                  (5)
+#define PN532_REPLAY_WAKEUP                 (6)
+
+#define PN532_REPLAY_REALTIME               (0)
+#define PN532_REPLAY_FAST                   (1)
+
+typedef struct _PN532_ReplayStats {
+    uint32_t records;       // records served
+    uint32_t mismatches;    // writes which differ from the recorded frame
+    uint32_t underruns;     // calls past the end or out of order
+    uint64_t virtual_us;    // virtual clock in fast mode
+} PN532_ReplayStats;
+
+int PN532_Record_Start(PN532* pn532, const char* path);
+void PN532_Record_Stop(PN532* pn532);
+int PN532_Replay_Init(PN532* pn532, const char* path, uint8_t mode);
+bool PN532_Replay_Done(void);
+void PN532_Replay_Stats(PN532_ReplayStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* PN532_REPLAY_H */
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <linux/i2c-dev.h>
 #include <linux/i2c.h>
+#include <linux/spi/spidev.h>
 #include <time.h>
 
 #include "wiringPi.h"
@@ -48,12 +49,22 @@
 #define _SPI_DATAREAD                   (0x03)
 #define _SPI_READY                      (0x01)
 #define _SPI_CHANNEL                    (0)
+#define _SPI_SPEED                      (1000000)
 #define _NSS_PIN                        (4)
 
+#define _SPIDEV_DEVICE                  "/dev/spidev0.0"
+#define _SPIDEV_SPEED                   _SPI_SPEED
+#define _SPIDEV_CS_DELAY_US             (10)
+#define _SPIDEV_POLL_US                 (1000)
+#define _SPIDEV_WAKEUP_US               (10000)
+#define _SPIDEV_OSC_START_US            (2000)
+
 #define _I2C_READY                      (0x01)
 #define _I2C_ADDRESS                    (0x48 >> 1)
 #define _I2C_CHANNEL                    (1)
 
+#define _PROBE_TIMEOUT                  (30)
+
 static int fd = 0;
 
 /**************************************************************************
@@ -76,6 +87,38 @@ void PN532_Log(const char* log) {
 void PN532_Trace(const char* cap, uint8_t *buf, uint8_t sz) {
     log_trc ("%s: %s", cap, dumpHexData(buf, sz, 0));
 }
+
+static uint32_t monotonic_us(void) {
+    struct timespec timenow;
+    clock_gettime(CLOCK_MONOTONIC, &timenow);
+    return (uint32_t)timenow.tv_sec * 1000000u + timenow.tv_nsec / 1000;
+}
+
+static uint32_t elapsed_ms(struct timespec* start) {
+    struct timespec timenow;
+    clock_gettime(CLOCK_MONOTONIC, &timenow);
+    return (timenow.tv_sec - start->tv_sec) * 1000 + \
+           (timenow.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/**
+ * @brief: Bring the PN532 up after the bus is set up. A chip that already
+ *     answers a short GetFirmwareVersion probe keeps its state, so the slow
+ *     hardware reset and wakeup are only done when the probe fails or when
+ *     pn532->full_init is set.
+ */
+static void PN532_Startup(PN532* pn532, struct timespec* start) {
+    uint8_t version[4];
+    pn532->fast_started = !pn532->full_init
+        && PN532_ProbeFirmwareVersion(pn532, version, _PROBE_TIMEOUT) == PN532_STATUS_OK;
+    if (!pn532->fast_started) {
+        // hardware reset
+        pn532->reset();
+        // hardware wakeup
+        pn532->wakeup();
+    }
+    pn532->startup_ms = elapsed_ms(start);
+}
 /**************************************************************************
  * End: Reset and Log implements
  **************************************************************************/
@@ -131,6 +174,12 @@ int PN532_SPI_WriteData(uint8_t *data, uint16_t count) {
     return PN532_STATUS_OK;
 }
 
+bool PN532_SPI_IsReady(void) {
+    uint8_t status[] = {_SPI_STATREAD, 0x00};
+    rpi_spi_rw(status, sizeof(status));
+    return status[1] == _SPI_READY;
+}
+
 bool PN532_SPI_WaitReady(uint32_t timeout) {
     uint8_t status[] = {_SPI_STATREAD, 0x00};
     struct timespec timenow;
@@ -153,6 +202,14 @@ bool PN532_SPI_WaitReady(uint32_t timeout) {
     return false;
 }
 
+int PN532_SPI_SetClock(uint32_t hz) {
+    int spi_fd = wiringPiSPIGetFd(_SPI_CHANNEL);
+    if (spi_fd > 0) {
+        close(spi_fd);
+    }
+    return wiringPiSPISetup(_SPI_CHANNEL, hz) < 0 ? PN532_STATUS_ERROR : PN532_STATUS_OK;
+}
+
 int PN532_SPI_Wakeup(void) {
     // Send any special commands/data to wake up PN532
     uint8_t data[] = {0x00};
@@ -164,31 +221,256 @@ int PN532_SPI_Wakeup(void) {
     return PN532_STATUS_OK;
 }
 
+int PN532_SPI_Resume(void) {
+    // Leave power down: NSS low for T_osc_start, no power-up settling
+    uint8_t data[] = {0x00};
+    digitalWrite(_NSS_PIN, LOW);
+    delay(2);  // T_osc_start
+    rpi_spi_rw(data, 1);
+    return PN532_STATUS_OK;
+}
+
 void PN532_SPI_Init(PN532* pn532) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     // init the pn532 functions
     pn532->reset = PN532_Reset;
     pn532->read_data = PN532_SPI_ReadData;
     pn532->write_data = PN532_SPI_WriteData;
     pn532->wait_ready = PN532_SPI_WaitReady;
+    pn532->is_ready = PN532_SPI_IsReady;
     pn532->wakeup = PN532_SPI_Wakeup;
+    pn532->resume = PN532_SPI_Resume;
     pn532->log = PN532_Log;
     pn532->trace = PN532_Trace;
+    pn532->delay = delay;
+    pn532->micros = monotonic_us;
+    pn532->set_clock = PN532_SPI_SetClock;
     // SPI setup
     if (wiringPiSetupGpio() < 0) {  // using Broadcom GPIO pin mapping
         return;
     }
     pinMode(_NSS_PIN, OUTPUT);
     pinMode(_RESET_PIN, OUTPUT);
-    wiringPiSPISetup(_SPI_CHANNEL, 1000000);
-    // hardware reset
-    pn532->reset();
-    // hardware wakeup
-    pn532->wakeup();
+    wiringPiSPISetup(_SPI_CHANNEL, _SPI_SPEED);
+    PN532_Startup(pn532, &start);
 }
 
 /**************************************************************************
  * End: SPI
  **************************************************************************/
+/**************************************************************************
+ * SPI over Linux spidev
+ *
+ * Chip select is driven by the kernel, status poll and data read go in
+ * one SPI_IOC_MESSAGE call. Bits are shifted LSB first by the controller
+ * when it supports SPI_LSB_FIRST, otherwise reversed with a lookup table.
+ * All ioctl calls go through spidev_ioctl, which can be replaced with
+ * PN532_SPIDEV_SetIoctl to run the transport against a mock.
+ **************************************************************************/
+static int spidev_sys_ioctl(int dev, unsigned long request, void* arg) {
+    return ioctl(dev, request, arg);
+}
+
+static int (*spidev_ioctl)(int dev, unsigned long request, void* arg) = spidev_sys_ioctl;
+static uint8_t spidev_lsb = 0;
+static uint32_t spidev_speed = _SPIDEV_SPEED;
+static uint8_t bit_reverse[256];
+
+void PN532_SPIDEV_SetIoctl(int (*fn)(int dev, unsigned long request, void* arg)) {
+    spidev_ioctl = fn ? fn : spidev_sys_ioctl;
+}
+
+static void spidev_delay(unsigned int ms) {
+    usleep(ms * 1000);
+}
+
+static void spidev_reverse(uint8_t* data, uint16_t count) {
+    if (spidev_lsb) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        data[i] = bit_reverse[data[i]];
+    }
+}
+
+/**
+ * @brief: Run transfers with a single ioctl, buffers are sent and received
+ *     in place. Chip select is released between the transfers.
+ */
+static int spidev_transfer(struct spi_ioc_transfer* xfer, uint8_t n) {
+    int r;
+    for (uint8_t i = 0; i < n; i++) {
+        xfer[i].rx_buf = xfer[i].tx_buf;
+        xfer[i].speed_hz = spidev_speed;
+        xfer[i].bits_per_word = 8;
+        xfer[i].delay_usecs = _SPIDEV_CS_DELAY_US;
+        xfer[i].cs_change = i + 1 < n;
+        spidev_reverse((uint8_t*)(uintptr_t)xfer[i].tx_buf, xfer[i].len);
+    }
+    r = spidev_ioctl(fd, SPI_IOC_MESSAGE(n), xfer);
+    for (uint8_t i = 0; i < n; i++) {
+        spidev_reverse((uint8_t*)(uintptr_t)xfer[i].rx_buf, xfer[i].len);
+    }
+    return r < 0 ? PN532_STATUS_ERROR : PN532_STATUS_OK;
+}
+
+int PN532_SPIDEV_ReadData(uint8_t* data, uint16_t count) {
+    uint8_t status[] = {_SPI_STATREAD, 0x00};
+    uint8_t frame[count + 1];
+    struct spi_ioc_transfer xfer[2];
+    memset(xfer, 0, sizeof(xfer));
+    memset(frame, 0, sizeof(frame));
+    frame[0] = _SPI_DATAREAD;
+    xfer[0].tx_buf = (uintptr_t)status;
+    xfer[0].len = sizeof(status);
+    xfer[1].tx_buf = (uintptr_t)frame;
+    xfer[1].len = count + 1;
+    if (spidev_transfer(xfer, 2) != PN532_STATUS_OK) {
+        return PN532_STATUS_ERROR;
+    }
+    if (status[1] != _SPI_READY) {
+        return PN532_STATUS_ERROR;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        data[i] = frame[i + 1];
+    }
+    return PN532_STATUS_OK;
+}
+
+int PN532_SPIDEV_WriteData(uint8_t *data, uint16_t count) {
+    uint8_t frame[count + 1];
+    struct spi_ioc_transfer xfer;
+    memset(&xfer, 0, sizeof(xfer));
+    frame[0] = _SPI_DATAWRITE;
+    for (uint16_t i = 0; i < count; i++) {
+        frame[i + 1] = data[i];
+    }
+    xfer.tx_buf = (uintptr_t)frame;
+    xfer.len = count + 1;
+    return spidev_transfer(&xfer, 1);
+}
+
+bool PN532_SPIDEV_IsReady(void) {
+    uint8_t status[] = {_SPI_STATREAD, 0x00};
+    struct spi_ioc_transfer xfer;
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (uintptr_t)status;
+    xfer.len = sizeof(status);
+    return spidev_transfer(&xfer, 1) == PN532_STATUS_OK && status[1] == _SPI_READY;
+}
+
+bool PN532_SPIDEV_WaitReady(uint32_t timeout) {
+    struct timespec timestart;
+    clock_gettime(CLOCK_MONOTONIC, &timestart);
+    while (1) {
+        if (PN532_SPIDEV_IsReady()) {
+            return true;
+        }
+        if (elapsed_ms(&timestart) > timeout) {
+            break;
+        }
+        usleep(_SPIDEV_POLL_US);
+    }
+    return false;
+}
+
+int PN532_SPIDEV_SetClock(uint32_t hz) {
+    if (spidev_ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &hz) < 0) {
+        return PN532_STATUS_ERROR;
+    }
+    spidev_speed = hz;
+    return PN532_STATUS_OK;
+}
+
+int PN532_SPIDEV_Wakeup(void) {
+    // Chip select held low for T_osc_start after the byte wakes up the PN532
+    uint8_t data[] = {0x00};
+    struct spi_ioc_transfer xfer;
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (uintptr_t)data;
+    xfer.len = sizeof(data);
+    xfer.delay_usecs = _SPIDEV_OSC_START_US;
+    spidev_transfer(&xfer, 1);
+    usleep(_SPIDEV_WAKEUP_US);
+    return PN532_STATUS_OK;
+}
+
+int PN532_SPIDEV_Resume(void) {
+    // Chip select stays low for T_osc_start after the byte
+    uint8_t data[] = {0x00};
+    struct spi_ioc_transfer xfer;
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (uintptr_t)data;
+    xfer.len = sizeof(data);
+    xfer.delay_usecs = _SPIDEV_OSC_START_US;
+    spidev_transfer(&xfer, 1);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief: Set up the PN532 functions on an open spidev device.
+ * @retval: -1 if the device can not be configured.
+ */
+int PN532_SPIDEV_Setup(PN532* pn532, int dev) {
+    uint8_t mode = SPI_MODE_0 | SPI_LSB_FIRST;
+    uint8_t bits = 8;
+    uint32_t speed = spidev_speed;
+    // init the pn532 functions
+    pn532->reset = PN532_Reset;
+    pn532->read_data = PN532_SPIDEV_ReadData;
+    pn532->write_data = PN532_SPIDEV_WriteData;
+    pn532->wait_ready = PN532_SPIDEV_WaitReady;
+    pn532->is_ready = PN532_SPIDEV_IsReady;
+    pn532->wakeup = PN532_SPIDEV_Wakeup;
+    pn532->resume = PN532_SPIDEV_Resume;
+    pn532->log = PN532_Log;
+    pn532->trace = PN532_Trace;
+    pn532->delay = spidev_delay;
+    pn532->micros = monotonic_us;
+    pn532->set_clock = PN532_SPIDEV_SetClock;
+    for (uint16_t i = 0; i < 256; i++) {
+        bit_reverse[i] = reverse_bit(i);
+    }
+    fd = dev;
+    // BCM2835 and many other controllers have no LSB first mode
+    spidev_lsb = spidev_ioctl(fd, SPI_IOC_WR_MODE, &mode) >= 0;
+    if (!spidev_lsb) {
+        mode = SPI_MODE_0;
+        if (spidev_ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0) {
+            return PN532_STATUS_ERROR;
+        }
+    }
+    if (spidev_ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0
+        || spidev_ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+        return PN532_STATUS_ERROR;
+    }
+    return PN532_STATUS_OK;
+}
+
+void PN532_SPIDEV_Init(PN532* pn532) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int dev = open(_SPIDEV_DEVICE, O_RDWR);
+    if (dev < 0) {
+        fprintf(stderr, "Unable to open spidev device: %s\n", strerror(errno));
+        return;
+    }
+    if (PN532_SPIDEV_Setup(pn532, dev) != PN532_STATUS_OK) {
+        fprintf(stderr, "Unable to set up spidev device: %s\n", strerror(errno));
+        return;
+    }
+    // Reset pin is still driven with GPIO, out of the hot path
+    if (wiringPiSetupGpio() < 0) {  // using Broadcom GPIO pin mapping
+        return;
+    }
+    pinMode(_RESET_PIN, OUTPUT);
+    PN532_Startup(pn532, &start);
+}
+
+/**************************************************************************
+ * End: SPI over Linux spidev
+ **************************************************************************/
 /**************************************************************************
  * UART
  **************************************************************************/
@@ -229,6 +511,10 @@ int PN532_UART_WriteData(uint8_t *data, uint16_t count) {
     return PN532_STATUS_OK;
 }
 
+bool PN532_UART_IsReady(void) {
+    return serialDataAvail(fd) > 0;
+}
+
 bool PN532_UART_WaitReady(uint32_t timeout) {
     struct timespec timenow;
     struct timespec timestart;
@@ -257,15 +543,29 @@ int PN532_UART_Wakeup(void) {
     return PN532_STATUS_OK;
 }
 
+int PN532_UART_Resume(void) {
+    // 0x55 wakes the HSU, the preamble covers T_osc_start
+    uint8_t data[] = {0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    write(fd, data, sizeof(data));
+    delay(2);
+    return PN532_STATUS_OK;
+}
+
 void PN532_UART_Init(PN532* pn532) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     // init the pn532 functions
     pn532->reset = PN532_Reset;
     pn532->read_data = PN532_UART_ReadData;
     pn532->write_data = PN532_UART_WriteData;
     pn532->wait_ready = PN532_UART_WaitReady;
+    pn532->is_ready = PN532_UART_IsReady;
     pn532->wakeup = PN532_UART_Wakeup;
+    pn532->resume = PN532_UART_Resume;
     pn532->log = PN532_Log;
     pn532->trace = PN532_Trace;
+    pn532->delay = delay;
+    pn532->micros = monotonic_us;
     // UART setup
     fd = serialOpen("/dev/ttyS0", 115200);
     if (fd < 0) {
@@ -276,10 +576,7 @@ void PN532_UART_Init(PN532* pn532) {
         return;
     }
     pinMode(_RESET_PIN, OUTPUT);
-    // hardware reset
-    pn532->reset();
-    // hardware wakeup
-    pn532->wakeup();
+    PN532_Startup(pn532, &start);
 }
 /**************************************************************************
  * End: UART
@@ -306,6 +603,12 @@ int PN532_I2C_WriteData(uint8_t *data, uint16_t count) {
     return PN532_STATUS_OK;
 }
 
+bool PN532_I2C_IsReady(void) {
+    uint8_t status[] = {0x00};
+    read(fd, status, sizeof(status));
+    return status[0] == _I2C_READY;
+}
+
 bool PN532_I2C_WaitReady(uint32_t timeout) {
     uint8_t status[] = {0x00};
     struct timespec timenow;
@@ -338,15 +641,29 @@ int PN532_I2C_Wakeup(void) {
     return PN532_STATUS_OK;
 }
 
+int PN532_I2C_Resume(void) {
+    // Any transfer to our address wakes the PN532, it may be NACKed
+    uint8_t data[] = {0x00};
+    write(fd, data, sizeof(data));
+    delay(2);  // T_osc_start
+    return PN532_STATUS_OK;
+}
+
 void PN532_I2C_Init(PN532* pn532) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     // init the pn532 functions
     pn532->reset = PN532_Reset;
     pn532->read_data = PN532_I2C_ReadData;
     pn532->write_data = PN532_I2C_WriteData;
     pn532->wait_ready = PN532_I2C_WaitReady;
+    pn532->is_ready = PN532_I2C_IsReady;
     pn532->wakeup = PN532_I2C_Wakeup;
+    pn532->resume = PN532_I2C_Resume;
     pn532->log = PN532_Log;
     pn532->trace = PN532_Trace;
+    pn532->delay = delay;
+    pn532->micros = monotonic_us;
     char devname[20];
     snprintf(devname, 19, "/dev/i2c-%d", _I2C_CHANNEL);
     fd = open(devname, O_RDWR);
@@ -363,10 +680,7 @@ void PN532_I2C_Init(PN532* pn532) {
     }
     pinMode(_REQ_PIN, OUTPUT);
     pinMode(_RESET_PIN, OUTPUT);
-    // hardware reset
-    pn532->reset();
-    // hardware wakeup
-    pn532->wakeup();
+    PN532_Startup(pn532, &start);
 }
 /**************************************************************************
  * End: I2C
@@ -31,23 +31,42 @@
 
 int PN532_Reset(void);
 void PN532_Log(const char* log);
+void PN532_Trace(const char* cap, uint8_t *buf, uint8_t sz);
 
 void PN532_SPI_Init(PN532* dev);
 int PN532_SPI_ReadData(uint8_t* data, uint16_t count);
 int PN532_SPI_WriteData(uint8_t *data, uint16_t count);
 bool PN532_SPI_WaitReady(uint32_t timeout);
+bool PN532_SPI_IsReady(void);
 int PN532_SPI_Wakeup(void);
+int PN532_SPI_Resume(void);
+int PN532_SPI_SetClock(uint32_t hz);
+
+void PN532_SPIDEV_Init(PN532* dev);
+int PN532_SPIDEV_Setup(PN532* dev, int fd);
+void PN532_SPIDEV_SetIoctl(int (*fn)(int fd, unsigned long request, void* arg));
+int PN532_SPIDEV_ReadData(uint8_t* data, uint16_t count);
+int PN532_SPIDEV_WriteData(uint8_t *data, uint16_t count);
+bool PN532_SPIDEV_WaitReady(uint32_t timeout);
+bool PN532_SPIDEV_IsReady(void);
+int PN532_SPIDEV_Wakeup(void);
+int PN532_SPIDEV_Resume(void);
+int PN532_SPIDEV_SetClock(uint32_t hz);
 
 void PN532_UART_Init(PN532* dev);
 int PN532_UART_ReadData(uint8_t* data, uint16_t count);
 int PN532_UART_WriteData(uint8_t *data, uint16_t count);
 bool PN532_UART_WaitReady(uint32_t timeout);
+bool PN532_UART_IsReady(void);
 int PN532_UART_Wakeup(void);
+int PN532_UART_Resume(void);
 
 void PN532_I2C_Init(PN532* dev);
 int PN532_I2C_ReadData(uint8_t* data, uint16_t count);
 int PN532_I2C_WriteData(uint8_t *data, uint16_t count);
 bool PN532_I2C_WaitReady(uint32_t timeout);
+bool PN532_I2C_IsReady(void);
 int PN532_I2C_Wakeup(void);
+int PN532_I2C_Resume(void);
 
 #endif  /* PN532_RPI */
@@ -0,0 +1,260 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "allowlist.h"
+
+static uint32_t monotonicMs (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000u + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a, the Bloom filter derives its hashes from both halves
+static uint64_t hashUid (const uint8_t *uid, uint8_t uid_length) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (uint8_t i = 0; i < uid_length; i++) {
+        h = (h ^ uid[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static uint32_t bloomBit (uint64_t h, uint16_t k, uint32_t bits) {
+    return ((uint32_t)h + k * (uint32_t)(h >> 32)) & (bits - 1);
+}
+
+static uint32_t roundPow2 (uint64_t v) {
+    uint32_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static void unmapIndex (Allowlist *list) {
+    if (list->map) {
+        munmap(list->map, list->size);
+        list->map = NULL;
+    }
+    list->header = NULL;
+}
+
+static int mapIndex (Allowlist *list) {
+    const AllowlistHeader *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(list->path, O_RDONLY);
+    if (fd < 0) {
+        log_wrn ("Can't open allowlist %s", list->path);
+        return PN532_STATUS_ERROR;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(AllowlistHeader)) {
+        log_wrn ("Allowlist %s is too short", list->path);
+        close(fd);
+        return PN532_STATUS_ERROR;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_wrn ("Can't map allowlist %s", list->path);
+        return PN532_STATUS_ERROR;
+    }
+    header = map;
+    if (header->magic != ALLOWLIST_MAGIC || header->version != ALLOWLIST_VERSION
+            || header->slots == 0 || (header->slots & (header->slots - 1))
+            || (header->bloom_bits & (header->bloom_bits - 1))
+            || (size_t)st.st_size != sizeof(AllowlistHeader) + header->bloom_bits / 8
+                                     + (size_t)header->slots * sizeof(AllowlistSlot)) {
+        log_wrn ("Allowlist %s is not a valid index", list->path);
+        munmap(map, st.st_size);
+        return PN532_STATUS_ERROR;
+    }
+    unmapIndex(list);
+    list->map = map;
+    list->size = st.st_size;
+    list->ino = st.st_ino;
+    list->header = header;
+    list->bloom = (const uint64_t *)(header + 1);
+    list->table = (const AllowlistSlot *)((const uint8_t *)list->bloom + header->bloom_bits / 8);
+    log_inf ("Allowlist %s: %u UIDs in %u slots, Bloom filter %u bits", list->path,
+            header->count, header->slots, header->bloom_bits);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Map a prebuilt allowlist index
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Allowlist_Open (Allowlist *list, const char *path) {
+    memset(list, 0, sizeof(Allowlist));
+    list->path = path;
+    list->checked_ms = monotonicMs();
+    return mapIndex(list);
+}
+
+/**
+ * @brief Decide on a UID. The index file is re-mapped when it was replaced
+ * (renamed over) since the last check, the old mapping serves until then.
+ *
+ * @return ALLOWLIST_ALLOW or ALLOWLIST_DENY
+ */
+int Allowlist_Check (Allowlist *list, const uint8_t *uid, uint8_t uid_length) {
+    const AllowlistSlot *slot;
+    struct stat st;
+    uint32_t now = monotonicMs(), ix, mask, probes;
+    uint64_t h;
+    uint16_t k;
+
+    if (now - list->checked_ms >= ALLOWLIST_RECHECK_MS) {
+        list->checked_ms = now;
+        if (stat(list->path, &st) == 0 && (st.st_ino != list->ino || !list->header)) {
+            mapIndex(list);
+        }
+    }
+    if (!list->header || uid_length == 0 || uid_length > ALLOWLIST_UID_MAX) return ALLOWLIST_DENY;
+    list->lookups++;
+    h = hashUid(uid, uid_length);
+    for (k = 0; k < list->header->hashes && list->header->bloom_bits; k++) {
+        ix = bloomBit(h, k, list->header->bloom_bits);
+        if (!(list->bloom[ix >> 6] & (1ULL << (ix & 63)))) {
+            list->prefiltered++;
+            return ALLOWLIST_DENY;
+        }
+    }
+    mask = list->header->slots - 1;
+    for (ix = h & mask, probes = 0; probes <= mask; ix = (ix + 1) & mask, probes++) {
+        slot = list->table + ix;
+        if (slot->length == 0) break;
+        if (slot->length == uid_length && memcmp(slot->uid, uid, uid_length) == 0) return ALLOWLIST_ALLOW;
+    }
+    return ALLOWLIST_DENY;
+}
+
+void Allowlist_Close (Allowlist *list) {
+    unmapIndex(list);
+}
+
+/**
+ * @brief Parse a hex UID, spaces and colons between bytes are ignored
+ *
+ * @return UID length, 0 for empty/comment lines, -1 if malformed
+ */
+static int parseUid (const char *line, uint8_t *uid) {
+    int n = 0, half = 0;
+    uint8_t v = 0;
+
+    for (; *line && *line != '#'; line++) {
+        if (isspace((unsigned char)*line) || *line == ':') continue;
+        if (!isxdigit((unsigned char)*line) || n >= ALLOWLIST_UID_MAX) return -1;
+        v = (v << 4) | (isdigit((unsigned char)*line) ? *line - '0' : (tolower((unsigned char)*line) - 'a' + 10));
+        if (++half == 2) {
+            uid[n++] = v;
+            half = 0;
+            v = 0;
+        }
+    }
+    return half ? -1 : n;
+}
+
+/**
+ * @brief Build the index from a text file of hex UIDs, one per line. The
+ * index is written next to path and renamed over it, so readers swap to it
+ * atomically.
+ *
+ * @param bloom add the Bloom prefilter
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Allowlist_Build (const char *source, const char *path, bool bloom) {
+    char line[ALLOWLIST_LINE_SZ], tmp[ALLOWLIST_PATH_SZ];
+    uint8_t uid[ALLOWLIST_UID_MAX];
+    AllowlistHeader header;
+    AllowlistSlot *table;
+    uint64_t *filter = NULL, h;
+    uint32_t count = 0, lineNo = 0, ix, mask;
+    int n, ret = PN532_STATUS_ERROR;
+    FILE *in, *out;
+
+    in = fopen(source, "r");
+    if (!in) {
+        log_err ("Can't open allowlist source %s", source);
+        return PN532_STATUS_ERROR;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        count += parseUid(line, uid) > 0;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = ALLOWLIST_MAGIC;
+    header.version = ALLOWLIST_VERSION;
+    header.slots = roundPow2((uint64_t)count * 2 + 1);  // load factor <= 0.5
+    if (bloom && count) {
+        header.bloom_bits = roundPow2((uint64_t)count * ALLOWLIST_BLOOM_BITS);
+        if (header.bloom_bits < 64) header.bloom_bits = 64;
+        header.hashes = ALLOWLIST_BLOOM_HASHES;
+    }
+    table = calloc(header.slots, sizeof(AllowlistSlot));
+    if (header.bloom_bits) filter = calloc(header.bloom_bits / 64, sizeof(uint64_t));
+    if (!table || (header.bloom_bits && !filter)) {
+        log_err ("No memory for %u UIDs", count);
+        goto done;
+    }
+
+    rewind(in);
+    mask = header.slots - 1;
+    while (fgets(line, sizeof(line), in)) {
+        lineNo++;
+        n = parseUid(line, uid);
+        if (n < 0) log_wrn ("%s:%u: malformed UID skipped", source, lineNo);
+        if (n <= 0) continue;
+        h = hashUid(uid, n);
+        for (ix = h & mask; table[ix].length; ix = (ix + 1) & mask) {
+            if (table[ix].length == n && memcmp(table[ix].uid, uid, n) == 0) break;
+        }
+        if (table[ix].length) continue;     // duplicate
+        table[ix].length = n;
+        memcpy(table[ix].uid, uid, n);
+        header.count++;
+        for (uint16_t k = 0; k < header.hashes; k++) {
+            uint32_t bit = bloomBit(h, k, header.bloom_bits);
+            filter[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    out = fopen(tmp, "w");
+    if (!out) {
+        log_err ("Can't create %s", tmp);
+        goto done;
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+            || (header.bloom_bits && fwrite(filter, header.bloom_bits / 8, 1, out) != 1)
+            || fwrite(table, sizeof(AllowlistSlot), header.slots, out) != header.slots
+            || fflush(out) != 0 || fsync(fileno(out)) != 0) {
+        log_err ("Can't write %s", tmp);
+        fclose(out);
+        unlink(tmp);
+        goto done;
+    }
+    fclose(out);
+    if (rename(tmp, path) != 0) {
+        log_err ("Can't replace %s", path);
+        unlink(tmp);
+        goto done;
+    }
+    log_inf ("Allowlist %s built with %u UIDs", path, header.count);
+    ret = PN532_STATUS_OK;
+done:
+    free(filter);
+    free(table);
+    fclose(in);
+    return ret;
+}
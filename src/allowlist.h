@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ALLOWLIST_MAGIC         0x4C574C41  // "ALWL"
+#define ALLOWLIST_VERSION       1
+#define ALLOWLIST_UID_MAX       10
+#define ALLOWLIST_BLOOM_BITS    16          // Bloom filter bits per UID
+#define ALLOWLIST_BLOOM_HASHES  7
+#define ALLOWLIST_RECHECK_MS    1000        // how often the index file is checked for a swap
+#define ALLOWLIST_LINE_SZ       128
+#define ALLOWLIST_PATH_SZ       512
+
+#define ALLOWLIST_DENY          0
+#define ALLOWLIST_ALLOW         1
+
+/**
+ * Index file: header, Bloom filter of bloom_bits bits (0 - no prefilter),
+ * then an open addressing table of slots entries with linear probing.
+ * A slot is 16 bytes, four slots share a cache line.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hashes;        // Bloom filter hash count
+    uint32_t count;         // UIDs in the table
+    uint32_t slots;         // power of two
+    uint32_t bloom_bits;    // power of two or 0
+    uint32_t reserved[3];
+} AllowlistHeader;
+
+typedef struct {
+    uint8_t length;         // 0 - empty slot
+    uint8_t uid[ALLOWLIST_UID_MAX];
+    uint8_t reserved[5];
+} AllowlistSlot;
+
+typedef struct {
+    const char *path;
+    void *map;
+    size_t size;
+    const AllowlistHeader *header;
+    const uint64_t *bloom;
+    const AllowlistSlot *table;
+    ino_t ino;              // mapped file, a new inode means the index was swapped
+    uint32_t checked_ms;
+    uint32_t lookups;
+    uint32_t prefiltered;   // denials answered by the Bloom filter alone
+} Allowlist;
+
+int Allowlist_Open (Allowlist *list, const char *path);
+int Allowlist_Check (Allowlist *list, const uint8_t *uid, uint8_t uid_length);
+void Allowlist_Close (Allowlist *list);
+int Allowlist_Build (const char *source, const char *path, bool bloom);
@@ -0,0 +1,58 @@
+#include <string.h>
+#include <time.h>
+
+#include "lib/pn532.h"
+
+#include "event.h"
+
+/**
+ * @brief Fill the event header from the target, stamped with the current time
+ */
+void Event_Init (CardEvent *event, uint8_t type, const PN532_Target *target) {
+    struct timespec ts;
+
+    memset(event, 0, sizeof(CardEvent));
+    clock_gettime(CLOCK_REALTIME, &ts);
+    event->type = type;
+    event->card_type = target->type;
+    event->sak = target->sak;
+    event->atqa = target->atqa;
+    event->uid_length = target->uid_length > EVENT_UID_MAX ? EVENT_UID_MAX : target->uid_length;
+    memcpy(event->uid, target->uid, event->uid_length);
+    event->time_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t *putLE (uint8_t *p, uint64_t v, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        *p++ = (v >> (i * 8)) & 0xFF;
+    }
+    return p;
+}
+
+/**
+ * @brief Encode the event little endian:
+ * type, card type, SAK, UID length (1 byte each), ATQA (2), UID (10),
+ * time in us (8), sequence (4), data length (2), data
+ *
+ * @param buff EVENT_ENCODED_MAX bytes
+ * @return encoded length
+ */
+uint16_t Event_Encode (const CardEvent *event, uint8_t *buff) {
+    uint8_t *p = buff;
+    uint16_t length = event->data_length > EVENT_DATA_MAX ? EVENT_DATA_MAX : event->data_length;
+
+    *p++ = event->type;
+    *p++ = event->card_type;
+    *p++ = event->sak;
+    *p++ = event->uid_length;
+    p = putLE(p, event->atqa, 2);
+    memcpy(p, event->uid, EVENT_UID_MAX);
+    p += EVENT_UID_MAX;
+    p = putLE(p, event->time_us, 8);
+    p = putLE(p, event->sequence, 4);
+    p = putLE(p, length, 2);
+    if (length) {
+        memcpy(p, event->data, length);
+    }
+    return EVENT_HEADER_SZ + length;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "lib/pn532.h"
+
+#define EVENT_ARRIVED       1       // card selected
+#define EVENT_DATA          2       // blocks read from the card
+#define EVENT_REMOVED       3       // card left the field
+#define EVENT_ACCESS        4       // allowlist decision, data is one byte ALLOWLIST_ALLOW/DENY
+#define EVENT_CONTINUED     5       // same card tapped again within debounce, not read again
+#define EVENT_CHANGES       6       // rows which differ from the stored dump, see EVENT_CHANGE_*
+
+// EVENT_CHANGES data is a list of rows: number (2, little endian), STORE_NEW or
+// STORE_CHANGED (1), row length (1), value, previous value (changed rows only)
+#define EVENT_CHANGE_HEADER 4
+
+#define EVENT_UID_MAX       10
+#define EVENT_DATA_MAX      4096    // MIFARE Classic 4K dump
+#define EVENT_HEADER_SZ     30      // encoded event without data
+#define EVENT_ENCODED_MAX   (EVENT_HEADER_SZ + EVENT_DATA_MAX)
+
+/**
+ * Card event passed to every sink. data is the card image indexed by block
+ * (16 bytes) or page (4 bytes), blocks which were not read are zero.
+ */
+typedef struct {
+    uint8_t type;           // EVENT_*
+    uint8_t card_type;      // PN532_CARD_*
+    uint8_t sak;
+    uint8_t uid_length;
+    uint16_t atqa;
+    uint8_t uid[EVENT_UID_MAX];
+    uint64_t time_us;       // CLOCK_REALTIME
+    uint32_t sequence;      // events published since start
+    uint16_t data_length;
+    const uint8_t *data;
+} CardEvent;
+
+void Event_Init (CardEvent *event, uint8_t type, const PN532_Target *target);
+uint16_t Event_Encode (const CardEvent *event, uint8_t *buff);
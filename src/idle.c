@@ -0,0 +1,147 @@
+#include <string.h>
+#include <time.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "idle.h"
+
+/**
+ * @brief Idle time on the transport clock, so replayed sessions keep
+ * their power down decisions
+ */
+static uint64_t idleUs (Idle *idle, PN532 *pReader) {
+    struct timespec ts;
+    uint32_t us;
+
+    if (!pReader->micros) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+    us = pReader->micros();
+    if (idle->clock_started) {
+        idle->clock_us += us - idle->last_us;
+    }
+    idle->clock_started = 1;
+    idle->last_us = us;
+    return idle->clock_us;
+}
+
+/**
+ * @brief Size the slice from the slowest resume and wake to UID seen: a card
+ * which came during a slice waits for the rest of it, the resume and the poll
+ */
+static void adaptSlice (Idle *idle) {
+    uint32_t wake_ms, wake_us = idle->resume_max_us;
+
+    if (idle->probe_max_us > wake_us) {
+        wake_us = idle->probe_max_us;
+    }
+    if (idle->wake_to_uid_max_us > wake_us) {
+        wake_us = idle->wake_to_uid_max_us;
+    }
+    wake_ms = (wake_us + 999) / 1000;
+    idle->sleep_ms = wake_ms + IDLE_SLEEP_MIN_MS < IDLE_LATENCY_BUDGET_MS ?
+            IDLE_LATENCY_BUDGET_MS - wake_ms : IDLE_SLEEP_MIN_MS;
+}
+
+/**
+ * @brief Set up the idle manager, the PN532 stays awake until Idle_Reset
+ * starts the idle timer
+ *
+ * @param idle_after_ms time without a card before power down, 0 - never
+ * @param preset RF preset applied at start, its max retries come back
+ * after low power, NULL - PN532 defaults
+ */
+void Idle_Init (Idle *idle, uint32_t idle_after_ms, const PN532_RFPreset *preset) {
+    memset(idle, 0, sizeof(Idle));
+    idle->idle_after_ms = idle_after_ms;
+    idle->sleep_ms = IDLE_SLEEP_MIN_MS;
+    idle->retries_atr = preset ? preset->max_retries_atr : PN532_RF_RETRIES_INFINITE;
+    idle->retries_psl = preset ? preset->max_retries_psl : 0x01;
+    idle->retries_passive = preset ? preset->max_retries_passive : PN532_RF_RETRIES_INFINITE;
+}
+
+/**
+ * @brief Restart the idle timer, the field is empty from now on
+ */
+void Idle_Reset (Idle *idle, PN532 *pReader) {
+    idle->idle_since_us = idleUs(idle, pReader);
+}
+
+/**
+ * @brief Sleep one power down slice if the reader has been idle long
+ * enough. The first slice cuts the passive activation retries, so the
+ * poll after each resume returns at once on an empty field.
+ *
+ * @return 1 if a slice was slept and the PN532 resumed, 0 if the caller
+ * keeps its own idle pause
+ */
+int Idle_Sleep (Idle *idle, PN532 *pReader) {
+    uint64_t now;
+
+    if (!idle->idle_after_ms) return 0;
+    now = idleUs(idle, pReader);
+    if (!idle->low_power) {
+        if (now - idle->idle_since_us < idle->idle_after_ms * 1000ULL) return 0;
+        if (PN532_SetMaxRetries(pReader, idle->retries_atr, idle->retries_psl, IDLE_PROBE_RETRIES) != PN532_ERROR_NONE) {
+            log_wrn ("Can't set probe retries, low power postponed");
+            idle->failures++;
+            idle->idle_since_us = now;
+            return 0;
+        }
+        idle->low_power = 1;
+        log_inf ("No card for %u s, power down in %u ms slices", idle->idle_after_ms / 1000, idle->sleep_ms);
+    } else if (idle->slices && now - idle->woke_us > idle->probe_max_us) {
+        idle->probe_max_us = now - idle->woke_us;
+        adaptSlice(idle);
+    }
+    if (PN532_PowerDown(pReader, IDLE_WAKE_SOURCES) != PN532_ERROR_NONE) {
+        log_dbg ("PowerDown refused");
+        idle->failures++;
+        return 0;
+    }
+    pReader->delay(idle->sleep_ms);
+
+    idle->woke_us = idleUs(idle, pReader);
+    if (PN532_Resume(pReader) != PN532_STATUS_OK) {
+        idle->failures++;
+    }
+    idle->resume_us = idleUs(idle, pReader) - idle->woke_us;
+    if (idle->resume_us > idle->resume_max_us) {
+        idle->resume_max_us = idle->resume_us;
+    }
+    adaptSlice(idle);
+    idle->slices++;
+    return 1;
+}
+
+/**
+ * @brief Account a card found in low power and give the PN532 its
+ * regular poll retries back
+ *
+ * @return PN532_ERROR_NONE or PN532 error code of the retries restore
+ */
+int Idle_CardFound (Idle *idle, PN532 *pReader) {
+    if (!idle->low_power) return PN532_ERROR_NONE;
+    idle->low_power = 0;
+    idle->wake_to_uid_us = idleUs(idle, pReader) - idle->woke_us;
+    if (idle->wake_to_uid_us > idle->wake_to_uid_max_us) {
+        idle->wake_to_uid_max_us = idle->wake_to_uid_us;
+    }
+    idle->wake_to_uid_sum_us += idle->wake_to_uid_us;
+    idle->cards++;
+    idle->added_us = idle->sleep_ms * 1000 + idle->wake_to_uid_us;
+    if (idle->added_us > idle->added_max_us) {
+        idle->added_max_us = idle->added_us;
+    }
+    log_inf ("Woke for card: added latency up to %u us (max %u) = slice %u ms + resume %u us + poll %u us, "
+            "wake to UID mean %u us, %u slices",
+            idle->added_us, idle->added_max_us, idle->sleep_ms, idle->resume_us,
+            idle->wake_to_uid_us - idle->resume_us, (uint32_t)(idle->wake_to_uid_sum_us / idle->cards), idle->slices);
+    if (idle->added_us > IDLE_LATENCY_BUDGET_MS * 1000) {
+        log_wrn ("Power down added %u ms tap latency, over the %u ms budget", idle->added_us / 1000, IDLE_LATENCY_BUDGET_MS);
+    }
+    adaptSlice(idle);
+    return PN532_SetMaxRetries(pReader, idle->retries_atr, idle->retries_psl, idle->retries_passive);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+#include "lib/pn532.h"
+
+#define IDLE_LATENCY_BUDGET_MS  50      // extra tap latency the power saving may cost
+#define IDLE_SLEEP_MIN_MS       10      // shortest power down slice worth the resume
+#define IDLE_PROBE_RETRIES      0x01    // passive activation retries of a poll in low power
+#define IDLE_WAKE_SOURCES       (PN532_WAKE_HOST | PN532_WAKE_RF)
+
+/**
+ * Idle power manager: after idle_after_ms without a card the PN532 is put
+ * into power down in slices of sleep_ms, each slice ends with a fast resume
+ * and one short poll. The RF level detector can't see passive cards, so the
+ * slice is sized to keep slice + resume + poll within IDLE_LATENCY_BUDGET_MS.
+ */
+typedef struct {
+    uint32_t idle_after_ms;     // 0 - never power down
+    uint32_t sleep_ms;          // power down slice, budget minus the slowest wake to UID
+    uint8_t low_power;          // probe retries are set, slices are running
+    uint8_t retries_atr;        // max retries restored on leaving low power
+    uint8_t retries_psl;
+    uint8_t retries_passive;
+    uint64_t idle_since_us;     // when the last card went away
+    uint64_t woke_us;           // start of the last resume
+    uint32_t resume_us;         // last resume, transport hook until the PN532 answers
+    uint32_t resume_max_us;
+    uint32_t probe_max_us;      // resume start to the next slice: resume + empty poll
+    uint32_t wake_to_uid_us;    // last card: resume start to selected UID, resume + poll
+    uint32_t wake_to_uid_max_us;
+    uint64_t wake_to_uid_sum_us;
+    uint32_t added_us;          // last card worst case: slice + resume + poll
+    uint32_t added_max_us;
+    uint32_t cards;             // cards found in low power
+    uint32_t slices;            // power down slices slept
+    uint32_t failures;          // PowerDown refused or resume not answered
+    uint64_t clock_us;          // accumulated from pReader->micros
+    uint32_t last_us;
+    uint8_t clock_started;
+} Idle;
+
+void Idle_Init (Idle *idle, uint32_t idle_after_ms, const PN532_RFPreset *preset);
+void Idle_Reset (Idle *idle, PN532 *pReader);
+int Idle_Sleep (Idle *idle, PN532 *pReader);
+int Idle_CardFound (Idle *idle, PN532 *pReader);
@@ -0,0 +1,222 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "journal.h"
+
+static uint32_t crcTable[256];
+
+static uint32_t crc32 (const uint8_t *data, uint32_t length) {
+    uint32_t crc = 0xFFFFFFFF, c, i, k;
+
+    if (!crcTable[1]) {
+        for (i = 0; i < 256; i++) {
+            for (c = i, k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            crcTable[i] = c;
+        }
+    }
+    for (i = 0; i < length; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t monotonicMs (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000u + ts.tv_nsec / 1000000;
+}
+
+static uint32_t getLE32 (const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putLE32 (uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static void segmentPath (Journal *journal, uint32_t segment, char *path) {
+    snprintf(path, JOURNAL_PATH_SZ, "%s/journal-%08u.log", journal->dir, segment);
+}
+
+/**
+ * @brief Open a segment for appending. Records of an existing segment are
+ * checked and a torn or corrupted tail is truncated.
+ */
+static int openSegment (Journal *journal, uint32_t segment) {
+    char path[JOURNAL_PATH_SZ];
+    uint8_t header[JOURNAL_RECORD_HEADER], payload[EVENT_ENCODED_MAX];
+    uint32_t length, records = 0;
+    struct stat st;
+    off_t ofs = 0;
+
+    segmentPath(journal, segment, path);
+    journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal->fd < 0 || fstat(journal->fd, &st) < 0) {
+        log_err ("Can't open journal %s", path);
+        if (journal->fd >= 0) {
+            close(journal->fd);
+            journal->fd = -1;
+        }
+        return PN532_STATUS_ERROR;
+    }
+    while (pread(journal->fd, header, sizeof(header), ofs) == sizeof(header)) {
+        length = getLE32(header);
+        if (length < EVENT_HEADER_SZ || length > EVENT_ENCODED_MAX
+                || pread(journal->fd, payload, length, ofs + sizeof(header)) != (ssize_t)length
+                || crc32(payload, length) != getLE32(header + 4)) {
+            break;
+        }
+        ofs += sizeof(header) + length;
+        records++;
+    }
+    if (ofs < st.st_size) {
+        log_wrn ("Journal %s: torn tail of %ld bytes after %u records truncated", path, (long)(st.st_size - ofs), records);
+        if (ftruncate(journal->fd, ofs) < 0 || fdatasync(journal->fd) < 0) {
+            log_err ("Can't truncate journal %s", path);
+            close(journal->fd);
+            journal->fd = -1;
+            return PN532_STATUS_ERROR;
+        }
+    }
+    journal->segment = segment;
+    journal->size = ofs;
+    log_inf ("Journal %s open with %u records", path, records);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Open the last segment of the journal directory
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Journal_Open (Journal *journal, const char *dir) {
+    struct dirent *entry;
+    uint32_t segment = 0, n;
+    DIR *d;
+
+    memset(journal, 0, sizeof(Journal));
+    journal->dir = dir;
+    journal->fd = -1;
+    d = opendir(dir);
+    if (!d) {
+        log_err ("Can't open journal directory %s", dir);
+        return PN532_STATUS_ERROR;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        if (sscanf(entry->d_name, "journal-%8u.log", &n) == 1 && n > segment) {
+            segment = n;
+        }
+    }
+    closedir(d);
+    return openSegment(journal, segment);
+}
+
+/**
+ * @brief Write buffered records and make them durable, rotate the segment
+ * once it is full
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Journal_Commit (Journal *journal) {
+    uint64_t committed = journal->size - journal->fill;
+    uint32_t ofs = 0;
+    ssize_t n;
+    int fd;
+
+    if (journal->fd < 0) return PN532_STATUS_ERROR;
+    while (ofs < journal->fill) {
+        n = write(journal->fd, journal->buffer + ofs, journal->fill - ofs);
+        if (n < 0) {
+            // Drop the partial group so later records don't follow a torn one
+            log_err ("Journal write failed, %u events lost", journal->pending);
+            if (ftruncate(journal->fd, committed) < 0) {
+                log_err ("Can't truncate the journal");
+            }
+            journal->size = committed;
+            journal->fill = 0;
+            journal->pending = 0;
+            return PN532_STATUS_ERROR;
+        }
+        ofs += n;
+    }
+    journal->fill = 0;
+    if (journal->pending && fdatasync(journal->fd) < 0) {
+        log_err ("Journal sync failed");
+        return PN532_STATUS_ERROR;
+    }
+    journal->pending = 0;
+    journal->commits++;
+    if (journal->size >= JOURNAL_SEGMENT_SZ) {
+        fd = journal->fd;
+        if (openSegment(journal, journal->segment + 1) != PN532_STATUS_OK) {
+            // Keep appending to the full segment, the next commit tries again
+            journal->fd = fd;
+            return PN532_STATUS_OK;
+        }
+        close(fd);
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Buffer the event, the group is committed once it has
+ * JOURNAL_SYNC_EVENTS events or the buffer is full
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Journal_Append (Journal *journal, const CardEvent *event) {
+    uint8_t *record;
+    uint16_t length;
+
+    if (journal->fd < 0) return PN532_STATUS_ERROR;
+    if (JOURNAL_BUFFER_SZ - journal->fill < JOURNAL_RECORD_HEADER + EVENT_ENCODED_MAX
+            && Journal_Commit(journal) != PN532_STATUS_OK) {
+        return PN532_STATUS_ERROR;
+    }
+    record = journal->buffer + journal->fill;
+    length = Event_Encode(event, record + JOURNAL_RECORD_HEADER);
+    putLE32(record, length);
+    putLE32(record + 4, crc32(record + JOURNAL_RECORD_HEADER, length));
+    journal->fill += JOURNAL_RECORD_HEADER + length;
+    journal->size += JOURNAL_RECORD_HEADER + length;
+    journal->events++;
+    if (journal->pending++ == 0) {
+        journal->first_ms = monotonicMs();
+    }
+    if (journal->pending >= JOURNAL_SYNC_EVENTS) {
+        return Journal_Commit(journal);
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Commit buffered events which waited JOURNAL_SYNC_MS, call it from the read loop
+ */
+int Journal_Poll (Journal *journal) {
+    if (journal->pending && monotonicMs() - journal->first_ms >= JOURNAL_SYNC_MS) {
+        return Journal_Commit(journal);
+    }
+    return PN532_STATUS_OK;
+}
+
+void Journal_Close (Journal *journal) {
+    if (journal->fd < 0) return;
+    Journal_Commit(journal);
+    if (journal->fd >= 0) {
+        close(journal->fd);
+        journal->fd = -1;
+    }
+}
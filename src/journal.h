@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include "event.h"
+
+#define JOURNAL_SYNC_EVENTS     64          // commit after this many events...
+#define JOURNAL_SYNC_MS         200         // ...or this long after the first uncommitted one
+#define JOURNAL_SEGMENT_SZ      (8 << 20)   // start a new segment past this size
+#define JOURNAL_BUFFER_SZ       (256 << 10)
+#define JOURNAL_RECORD_HEADER   8           // payload length, CRC32 of payload
+#define JOURNAL_PATH_SZ         512
+
+/**
+ * Append-only journal of encoded card events in <dir>/journal-NNNNNNNN.log
+ * segments. Records are buffered and written with one write and one
+ * fdatasync per group commit.
+ */
+typedef struct {
+    const char *dir;
+    int fd;
+    uint32_t segment;       // number of the open segment
+    uint64_t size;          // bytes in the open segment, committed and buffered
+    uint32_t pending;       // events buffered since the last commit
+    uint32_t first_ms;      // when the first of them was buffered
+    uint32_t commits;
+    uint32_t events;
+    uint32_t fill;          // bytes in buffer
+    uint8_t buffer[JOURNAL_BUFFER_SZ];
+} Journal;
+
+int Journal_Open (Journal *journal, const char *dir);
+int Journal_Append (Journal *journal, const CardEvent *event);
+int Journal_Poll (Journal *journal);
+int Journal_Commit (Journal *journal);
+void Journal_Close (Journal *journal);
@@ -1,4 +1,6 @@
+#include <ctype.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -9,29 +11,124 @@
 
 #include "lib/pn532.h"
 #include "lib/pn532_rpi.h"
+#include "lib/mifare.h"
+#include "lib/ndef.h"
+#include "lib/pn532_replay.h"
 
 #include "config.h"
 #include "main.h"
+#include "session.h"
+#include "store.h"
+#include "allowlist.h"
+#include "event.h"
+#include "server.h"
+#include "ring.h"
+#include "journal.h"
+#include "provision.h"
+#include "idle.h"
 
 #define DUMP_BUF_SZ     2048
 #define DUMP_TXT_SZ     128
-#define LIST_BLK_SZ     512
+#define BLOCK_MAP_SZ    (MIFARE_CLASSIC_MAX_BLOCKS / 8)
+#define LAST_BLOCK_AUTO 0xFFFF   // read till the last block of the card
+#define CLOCK_FILE      "/var/lib/" PROJECT ".clock"
+#define CLOCK_BURST     20       // calls per clock rate in calibration
+#define POLL_IDLE_US    20000    // pause between early returning empty polls
 #define KEYS_SZ         10
+#define TAP_PINS_SZ     4        // LED, buzzer... on PN532 GPIO
+#define APDUS_SZ        16       // APDUs sent to ISO14443-4 cards
+#define APDU_DATA_SZ    1024
+
+// Read strategies
+#define READ_UID_ONLY   0   // block commands are not supported, UID only
+#define READ_CLASSIC    1   // MIFARE Classic: auth + 16-byte blocks
+#define READ_ULTRALIGHT 2   // Ultralight/NTAG: no auth, READ returns 4 pages
+#define READ_FELICA     3   // FeliCa: Read Without Encryption of the read-only service
+#define FELICA_READ_BLOCKS 4     // blocks per Read Without Encryption, FeliCa Lite-S limit
 
 typedef struct key_str {
     uint8_t key[6];
 } Key;
 
+typedef struct strategy_str {
+    uint8_t  type;          // PN532_CARD_*
+    uint8_t  method;        // READ_*
+    uint16_t blocks;        // addressable blocks (pages for Ultralight)
+} Strategy;
+
 int     gLogLevel       = LOG_LEVEL_WARNING; // Logging level
 int     gLogExtended    = 0;                 // Logging with file:line function
-uint8_t gFirstBlock     = 0;
-uint8_t gLastBlock      = 63;
-int     gBlocksCnt      = 0;
-uint8_t *gBlocks        = NULL;
+uint16_t gFirstBlock    = 0;
+uint16_t gLastBlock     = LAST_BLOCK_AUTO;
+int     gBlocksCnt      = 0;                 // Blocks in gBlocks list, 0 - use gFirstBlock-gLastBlock
+uint8_t gBlocks[BLOCK_MAP_SZ];               // Bitmap of blocks listed by -b
 char    *gBlocksName    = NULL;
+int     gKeyIx[2]       = {0, 0};            // Key A/B which fit last time, tried first
+int     gAuthCnt        = 0;                 // Auths per card read
+int     gReadCnt        = 0;                 // Reads per card read
+int     gWasteCnt       = 0;                 // Round-trips of failed auths/reads and re-selects
+int     gSkipCnt        = 0;                 // Blocks skipped as never readable
+Mifare_AccessCache gAccessCache;             // Access conditions per UID and sector
 Key     defaultKey      = {.key={0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}};
 Key     keys[KEYS_SZ];
 int     gKeyCount       = 0;
+int     gFullInit       = 0;                 // Always reset PN532 on startup
+const char *gTransport  = "spi";             // PN532 transport: spi, spidev, i2c, uart
+int     gCalibrate      = 0;                 // Calibrate SPI clock even if stored
+const char *gClockFile  = CLOCK_FILE;        // Calibrated SPI clock per transport
+const uint32_t clockRates[] = {1000000, 2000000, 3000000, 4000000, 5000000};
+int     gBench          = 0;                 // Calls per polling benchmark round, 0 - no benchmark
+const char *gRFPreset   = NULL;              // RFConfiguration preset, NULL - keep PN532 defaults
+useconds_t pollIdleUs   = 0;                 // Pause between empty polls that return early
+uint32_t gHoldoverMs    = SESSION_HOLDOVER_MS; // Card missing time before it is removed
+uint32_t gDebounceMs    = SESSION_DEBOUNCE_MS; // Same card re-tap window which continues the session
+const char *gStoreDir   = NULL;              // Directory of last dumps per UID, NULL - show full dumps
+BlockStore gStore;                           // Last dump of the card being read
+const char *gAllowlistFile = NULL;           // UID allowlist index, set - UID-only access decisions
+const char *gAllowlistSource = NULL;         // Text list of UIDs to build the index from
+Allowlist gAllowlist;
+uint8_t gTapPins[TAP_PINS_SZ];               // PN532 P3x/P7x pins driven high while a card is present
+int     gTapPinCnt      = 0;
+const PN532_AnalogProfile *gTuning = NULL;   // CIU analog profile applied to every activated card
+const char *gTuningName = NULL;
+const char *gSocketPath = NULL;              // Unix socket of the card event server, NULL - no server
+Server  gServer;
+const char *gShmName    = NULL;              // Shared memory event ring, NULL - no ring
+Ring    gRing;
+const char *gJournalDir = NULL;              // Directory of the card event journal, NULL - no journal
+Journal gJournal;
+const char *gRecordFile = NULL;              // Record transport traffic to this file
+const char *gReplayFile = NULL;              // Replay recorded traffic instead of hardware
+int     gReplayFast     = 0;                 // Replay on a virtual clock, as fast as possible
+const char *gProvisionFile = NULL;           // Dump image written to every card, NULL - read cards
+int     gWriteTrailers  = 0;                 // Provisioning writes sector trailers from the image
+Provision gProvision;
+PN532_Apdu gApdus[APDUS_SZ];                 // APDU batch sent to every ISO14443-4 card
+uint8_t gApduData[APDU_DATA_SZ];
+int     gApduCnt        = 0;
+int     gNdef           = 0;                 // Read only the NDEF message of Ultralight/NTAG
+NdefReader gNdefReader;
+uint8_t gPollTypes      = PN532_POLL_ISO14443A; // Card families polled, PN532_POLL_*
+uint32_t gIdleMs        = 0;                 // No card time before PN532 power down, 0 - never
+Idle    gIdle;
+volatile sig_atomic_t gRunning = 1;          // Cleared by SIGINT/SIGTERM to leave the read loop
+uint32_t gEventSeq      = 0;                 // Card events published
+uint8_t gDump[EVENT_DATA_MAX];               // Image of the card being read, by block or page
+uint16_t gDumpLength    = 0;
+uint8_t gChanges[EVENT_DATA_MAX];            // Rows changed since the stored dump, EVENT_CHANGES data
+uint16_t gChangesLength = 0;
+int     gChangesFull    = 0;                 // Changes didn't fit, the full image is published
+
+// Last entry is used for every card type not listed
+const Strategy strategies[] = {
+    {PN532_CARD_MIFARE_MINI,        READ_CLASSIC,        0},    // blocks from card geometry
+    {PN532_CARD_MIFARE_1K,          READ_CLASSIC,        0},
+    {PN532_CARD_MIFARE_2K,          READ_CLASSIC,        0},
+    {PN532_CARD_MIFARE_4K,          READ_CLASSIC,        0},
+    {PN532_CARD_MIFARE_ULTRALIGHT,  READ_ULTRALIGHT,   231},    // up to NTAG216, reads stop at first NAK
+    {PN532_CARD_FELICA,             READ_FELICA,        14},    // FeliCa Lite-S user blocks
+    {PN532_CARD_UNKNOWN,            READ_UID_ONLY,       0}
+};
 
 // Long command line options
 const struct option longOptions[] = {
@@ -41,7 +138,33 @@ const struct option longOptions[] = {
     {"key",         required_argument,  0,  'k'},
     {"start",       required_argument,  0,  's'},
     {"end",         required_argument,  0,  'e'},
-    {"blocks",      required_argument,  0,  'b'}
+    {"blocks",      required_argument,  0,  'b'},
+    {"reset",       no_argument,        0,  'R'},
+    {"transport",   required_argument,  0,  't'},
+    {"calibrate",   no_argument,        0,  'c'},
+    {"clock-file",  required_argument,  0,  'C'},
+    {"bench",       required_argument,  0,  'B'},
+    {"rf-preset",   required_argument,  0,  'P'},
+    {"holdover",    required_argument,  0,  'H'},
+    {"debounce",    required_argument,  0,  'D'},
+    {"store",       required_argument,  0,  'S'},
+    {"allowlist",   required_argument,  0,  'A'},
+    {"allowlist-source", required_argument, 0, 'L'},
+    {"tap-gpio",    required_argument,  0,  'G'},
+    {"tuning",      required_argument,  0,  'T'},
+    {"socket",      required_argument,  0,  'U'},
+    {"shm",         required_argument,  0,  'M'},
+    {"journal",     required_argument,  0,  'J'},
+    {"record",      required_argument,  0,  'W'},
+    {"replay",      required_argument,  0,  'Y'},
+    {"replay-fast", no_argument,        0,  'F'},
+    {"provision",   required_argument,  0,  'I'},
+    {"write-trailers", no_argument,     0,  'K'},
+    {"apdu",        required_argument,  0,  'Q'},
+    {"ndef",        no_argument,        0,  'N'},
+    {"poll",        required_argument,  0,  'O'},
+    {"power-down",  required_argument,  0,  'Z'},
+    {0,             0,                  0,  0}
 };
 
 const char *logLevelHeaders[] = {
@@ -124,111 +247,175 @@ const char *dumpKeys() {
     return _buf;
 }
 
+/**
+ * @brief Parse list of blocks like `1-3,5,8-` into gBlocks bitmap.
+ * `-N` starts from block 0, `N-` goes till the last block.
+ *
+ * @param list blocks list
+ */
 void parseBlocks (const char *list)  {
-    uint8_t sectors[LIST_BLK_SZ];
-    char dig[10] = {0};
-    memset(sectors, 0, LIST_BLK_SZ);
-    int beg = -1, end = -1, lst = 0, v;
-    size_t i, sz = strlen(list), ixDig = 0;
-    for (i = 0; i < sz; i++) {
-        char c = list[i];
-        // log_trc ("char=%c beg=%d end=%d ixDig=%d", c, beg, end, ixDig);
-        if ('0' <= c && c <= '9') {
-            dig[ixDig++] = c;
-            dig[ixDig] = 0;
-        } else if (c == '-') {
-            if (i == 0) {
-                beg = 0;
-                ixDig = 0;
-                continue;
-            } else if (beg < 0 && ixDig == 0) {
+    uint8_t map[BLOCK_MAP_SZ];
+    const char *p = list;
+    char *end;
+    long beg, fin, v;
+    int cnt = 0;
+
+    memset(map, 0, BLOCK_MAP_SZ);
+    while (*p) {
+        if (*p == '-') {
+            beg = 0;
+        } else {
+            beg = strtol(p, &end, 10);
+            if (end == p) {
                 log_wrn ("Invalid list: %s", list);
                 return;
             }
-            beg = atoi(dig);
-            dig[0] = 0;
-            ixDig = 0;
-        } else if (c == ',') {
-            if (beg >= 0 && ixDig) {
-                end = atoi(dig);
-                if (end >= beg) {
-                    for (v = beg; v <= end; v++) {
-                        sectors[lst++] = v;
-                        if (lst >= LIST_BLK_SZ) {
-                            log_wrn ("No space for list: %s", list);
-                            return;
-                        }
-                    }
-                } else {
-                    for (v = end; v <= beg; v++) {
-                        sectors[lst++] = v;
-                        if (lst >= LIST_BLK_SZ) {
-                            log_wrn ("No space for list: %s", list);
-                            return;
-                        }
-                    }
-                }
-                beg = -1;
-                end = -1;
-                dig[0] = 0;
-                ixDig = 0;
-            } else if (beg < 0 && ixDig) {
-                v = atoi(dig);
-                sectors[lst++] = v;
-                if (lst >= LIST_BLK_SZ) {
-                    log_wrn ("No space for list: %s", list);
+            p = end;
+        }
+        fin = beg;
+        if (*p == '-') {
+            p++;
+            if (*p == ',' || *p == 0) {
+                fin = MIFARE_CLASSIC_MAX_BLOCKS - 1;
+            } else {
+                fin = strtol(p, &end, 10);
+                if (end == p) {
+                    log_wrn ("Invalid list: %s", list);
                     return;
                 }
-                dig[0] = 0;
-                ixDig = 0;
-            } else {
-                log_wrn ("Invalid list: %s", list);
-                return;
+                p = end;
             }
         }
-    }
-    // log_trc ("FIN beg=%d end=%d ixDig=%d", beg, end, ixDig);
-    if (ixDig) {
-        if (beg < 0) {
-            if (lst < LIST_BLK_SZ) {
-                v = atoi(dig);
-                sectors[lst++] = v;
-            } else {
-                log_wrn ("No space for list: %s", list);
-            }
-        } else {
-            end = atoi(dig);
-            if (end >= beg) {
-                for (v = beg; v <= end; v++) {
-                    sectors[lst++] = v;
-                    if (lst >= LIST_BLK_SZ) {
-                        log_wrn ("No space for list: %s", list);
-                        break;
-                    }
-                }
-            } else {
-                for (v = end; v <= beg; v++) {
-                    sectors[lst++] = v;
-                    if (lst >= LIST_BLK_SZ) {
-                        log_wrn ("No space for list: %s", list);
-                        break;
-                    }
-                }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            log_wrn ("Invalid list: %s", list);
+            return;
+        }
+        if (fin < beg) {
+            v = beg;
+            beg = fin;
+            fin = v;
+        }
+        if (beg < 0 || fin >= MIFARE_CLASSIC_MAX_BLOCKS) {
+            log_wrn ("Blocks out of range 0-%d: %s", MIFARE_CLASSIC_MAX_BLOCKS - 1, list);
+            return;
+        }
+        for (v = beg; v <= fin; v++) {
+            if (!(map[v >> 3] & (1 << (v & 7)))) {
+                map[v >> 3] |= 1 << (v & 7);
+                cnt++;
             }
         }
     }
-    if (lst > 0) {
-        if (gBlocks) {
-            free(gBlocks);
+    if (cnt > 0) {
+        memcpy (gBlocks, map, BLOCK_MAP_SZ);
+        gBlocksCnt = cnt;
+        if (gBlocksName) {
+            free(gBlocksName);
         }
-        gBlocks = malloc (lst + 1);
-        memset (gBlocks, 0, lst + 1);
-        memcpy (gBlocks, sectors, lst);
-        gBlocksCnt = lst;
         gBlocksName = strdup (list);
     }
 }
 
+/**
+ * @brief Parse a block number of -s/-e, invalid input keeps the block unchanged
+ */
+void parseBlockNumber (const char *arg, uint16_t *block) {
+    char *end;
+    long v = strtol(arg, &end, 10);
+    if (end == arg || *end) {
+        log_wrn ("Invalid block number: %s", arg);
+        return;
+    }
+    if (v < 0 || v >= MIFARE_CLASSIC_MAX_BLOCKS) {
+        log_wrn ("Block %s out of range 0-%d", arg, MIFARE_CLASSIC_MAX_BLOCKS - 1);
+        v = v < 0 ? 0 : MIFARE_CLASSIC_MAX_BLOCKS - 1;
+    }
+    *block = (uint16_t) v;
+}
+
+/**
+ * @brief Parse comma separated PN532 GPIO pins for tap feedback, e.g. `32,71`
+ */
+void parseTapPins (const char *list) {
+    const char *p = list;
+    char *end;
+    long v;
+
+    gTapPinCnt = 0;
+    while (*p) {
+        v = strtol(p, &end, 10);
+        if (end == p || !((v >= 30 && v <= 35) || v == 71 || v == 72)) {
+            log_wrn ("Bad tap GPIO pin in %s, use P30-P35, P71, P72", list);
+            gTapPinCnt = 0;
+            return;
+        }
+        if (gTapPinCnt < TAP_PINS_SZ) {
+            gTapPins[gTapPinCnt++] = (uint8_t) v;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+/**
+ * @brief Parse comma separated hex APDUs, e.g. `905A000003010000,90BD0000070100000000000000`
+ */
+void parseApdus (const char *list) {
+    const char *p = list;
+    uint16_t used = 0, start;
+    char bByte[3] = {0, 0, 0};
+
+    gApduCnt = 0;
+    while (*p && gApduCnt < APDUS_SZ) {
+        start = used;
+        while (isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1]) && used < APDU_DATA_SZ) {
+            bByte[0] = p[0];
+            bByte[1] = p[1];
+            gApduData[used++] = (uint8_t) strtol (bByte, NULL, 16);
+            p += 2;
+        }
+        if (used - start < 4 || (*p && *p != ',')) {
+            log_wrn ("Bad APDU in %s, use hex bytes CLA INS P1 P2 [Lc data] [Le]", list);
+            gApduCnt = 0;
+            return;
+        }
+        gApdus[gApduCnt].command = gApduData + start;
+        gApdus[gApduCnt++].length = used - start;
+        if (*p == ',') p++;
+    }
+}
+
+/**
+ * @brief Parse comma separated card families to poll, e.g. `a,felica`
+ */
+void parsePollTypes (const char *list) {
+    static const struct { const char *name; uint8_t types; } families[] = {
+        {"a", PN532_POLL_ISO14443A}, {"felica", PN532_POLL_FELICA}, {"felica212", PN532_POLL_FELICA_212},
+        {"felica424", PN532_POLL_FELICA_424}, {"b", PN532_POLL_ISO14443B}, {"jewel", PN532_POLL_JEWEL},
+        {"all", PN532_POLL_ALL}
+    };
+    const char *p = list;
+    size_t i, n;
+
+    gPollTypes = 0;
+    while (*p) {
+        n = strcspn(p, ",");
+        for (i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+            if (strlen(families[i].name) == n && strncmp(p, families[i].name, n) == 0) break;
+        }
+        if (i == sizeof(families) / sizeof(families[0])) {
+            log_wrn ("Bad card family in %s, use a, felica, felica212, felica424, b, jewel, all", list);
+            gPollTypes = PN532_POLL_ISO14443A;
+            return;
+        }
+        gPollTypes |= families[i].types;
+        p += n;
+        if (*p == ',') p++;
+    }
+    if (!gPollTypes) gPollTypes = PN532_POLL_ISO14443A;
+}
+
 /**
  * @brief Parse cmdline arguments
  *
@@ -243,7 +430,7 @@ void parseArguments (int argc, char **argv) {
     char bByte[] = { 0, 0, 0 };
     Key key;
 
-    while ((i = getopt_long (argc, argv, "vqxk:s:e:b:", longOptions, NULL)) != -1) {
+    while ((i = getopt_long (argc, argv, "vqxRcFKNk:s:e:b:t:C:B:P:H:D:S:A:L:G:T:U:M:J:W:Y:I:Q:O:Z:", longOptions, NULL)) != -1) {
         switch (i) {
             case 'v': // verbose
                 gLogLevel++;
@@ -260,12 +447,112 @@ void parseArguments (int argc, char **argv) {
                 gLogExtended = 1;
                 break;
 
+            case 'R': // reset
+                gFullInit = 1;
+                break;
+
+            case 'c': // calibrate
+                gCalibrate = 1;
+                break;
+
+            case 'C': // clock file
+                gClockFile = optarg;
+                break;
+
+            case 'B': // bench
+                gBench = atoi(optarg);
+                break;
+
+            case 'P': // RF preset
+                gRFPreset = optarg;
+                break;
+
+            case 'H': // holdover
+                gHoldoverMs = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'D': // debounce
+                gDebounceMs = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'S': // store
+                gStoreDir = optarg;
+                break;
+
+            case 'A': // allowlist
+                gAllowlistFile = optarg;
+                break;
+
+            case 'L': // allowlist source
+                gAllowlistSource = optarg;
+                break;
+
+            case 'G': // tap GPIO pins
+                parseTapPins(optarg);
+                break;
+
+            case 'T': // analog tuning
+                gTuningName = optarg;
+                break;
+
+            case 'U': // event socket
+                gSocketPath = optarg;
+                break;
+
+            case 'M': // shared memory ring
+                gShmName = optarg;
+                break;
+
+            case 'J': // journal
+                gJournalDir = optarg;
+                break;
+
+            case 'W': // record
+                gRecordFile = optarg;
+                break;
+
+            case 'Y': // replay
+                gReplayFile = optarg;
+                break;
+
+            case 'F': // replay fast
+                gReplayFast = 1;
+                break;
+
+            case 'I': // provision
+                gProvisionFile = optarg;
+                break;
+
+            case 'K': // write trailers
+                gWriteTrailers = 1;
+                break;
+
+            case 'O': // poll types
+                parsePollTypes(optarg);
+                break;
+
+            case 'Z': // power down
+                gIdleMs = strtoul(optarg, NULL, 10) * 1000;
+                break;
+
+            case 'N': // NDEF
+                gNdef = 1;
+                break;
+
+            case 'Q': // APDUs
+                parseApdus(optarg);
+                break;
+
+            case 't': // transport
+                gTransport = optarg;
+                break;
+
             case 's': // start
-                gFirstBlock = atoi(optarg);
+                parseBlockNumber(optarg, &gFirstBlock);
                 break;
 
             case 'e': // end
-                gLastBlock = atoi(optarg);
+                parseBlockNumber(optarg, &gLastBlock);
                 break;
 
             case 'b': // blocks
@@ -300,33 +587,707 @@ void parseArguments (int argc, char **argv) {
     }
 }
 
-int readBlock(PN532 *pReader, uint8_t *uid, uint8_t uid_len, Key *key, uint8_t block_number) {
+/**
+ * @brief Load SPI clock stored for the transport. The file has a line
+ * `<transport> <hz>` per reader.
+ *
+ * @return clock in Hz, 0 if not stored
+ */
+uint32_t loadClock (const char *transport) {
+    char name[32];
+    unsigned int hz;
+    uint32_t found = 0;
+    FILE *f = fopen(gClockFile, "r");
+    if (!f) return 0;
+    while (fscanf(f, "%31s %u", name, &hz) == 2) {
+        if (strcmp(name, transport) == 0) found = hz;
+    }
+    fclose(f);
+    return found;
+}
+
+void saveClock (const char *transport, uint32_t hz) {
+    char name[32], lines[DUMP_BUF_SZ] = {0};
+    unsigned int v;
+    size_t ofs = 0;
+    FILE *f = fopen(gClockFile, "r");
+    if (f) {
+        while (fscanf(f, "%31s %u", name, &v) == 2 && ofs < DUMP_BUF_SZ) {
+            if (strcmp(name, transport) != 0) {
+                ofs += snprintf(lines + ofs, DUMP_BUF_SZ - ofs, "%s %u\n", name, v);
+            }
+        }
+        fclose(f);
+    }
+    f = fopen(gClockFile, "w");
+    if (!f) {
+        log_wrn ("Can't save SPI clock to %s", gClockFile);
+        return;
+    }
+    fprintf(f, "%s%s %u\n", lines, transport, hz);
+    fclose(f);
+}
+
+/**
+ * @brief Apply stored SPI clock, or find the fastest stable one and store it
+ */
+void setupClock (PN532 *pReader) {
+    uint32_t hz;
+    if (!pReader->set_clock) return;
+    hz = gCalibrate ? 0 : loadClock(gTransport);
+    if (hz && pReader->set_clock(hz) == PN532_STATUS_OK) {
+        log_inf ("SPI clock %u Hz", hz);
+        return;
+    }
+    log_inf ("Calibrating SPI clock...");
+    hz = PN532_CalibrateClock(pReader, clockRates, sizeof(clockRates) / sizeof(clockRates[0]), CLOCK_BURST);
+    if (hz) {
+        log_inf ("SPI clock calibrated to %u Hz", hz);
+        saveClock(gTransport, hz);
+    } else {
+        log_wrn ("No stable SPI clock found");
+    }
+}
+
+/**
+ * @brief Run the same command mix with fixed interval and adaptive ready polling
+ */
+void benchPolling (PN532 *pReader, int count) {
+    const char *modes[] = {"fixed", "adaptive"};
+    uint8_t version[4], echo[16];
+    struct timespec beg, end;
+    uint32_t polls;
+    double ms;
+    int m, i, failed;
+
+    memset(echo, 0xA5, sizeof(echo));
+    for (m = 0; m < 2; m++) {
+        pReader->fixed_polling = m == 0;
+        // Train latency models before the adaptive round
+        for (i = 0; m == 1 && i < PN532_LATENCY_WARMUP; i++) {
+            PN532_GetFirmwareVersion(pReader, version);
+            PN532_EchoTest(pReader, echo, sizeof(echo));
+        }
+        polls = pReader->polls;
+        failed = 0;
+        clock_gettime(CLOCK_MONOTONIC, &beg);
+        for (i = 0; i < count; i++) {
+            failed += PN532_GetFirmwareVersion(pReader, version) != PN532_STATUS_OK;
+            failed += PN532_EchoTest(pReader, echo, sizeof(echo)) != PN532_STATUS_OK;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ms = (end.tv_sec - beg.tv_sec) * 1000.0 + (end.tv_nsec - beg.tv_nsec) / 1000000.0;
+        log_all ("Polling %-8s: %d calls in %.1f ms, %.2f ms/call, %d failed",
+                modes[m], count * 2, ms, ms / (count * 2), failed);
+        if (m) {
+            log_inf ("Adaptive polling: %.1f ready checks/call", (double)(pReader->polls - polls) / (count * 2));
+        }
+    }
+    pReader->fixed_polling = 0;
+}
+
+int wantBlock(uint16_t block_number) {
+    if (gBlocksCnt) {
+        return block_number < MIFARE_CLASSIC_MAX_BLOCKS
+            && (gBlocks[block_number >> 3] & (1 << (block_number & 7)));
+    }
+    return block_number >= gFirstBlock && block_number <= gLastBlock;
+}
+
+const Strategy *findStrategy(uint8_t type) {
+    size_t i, last = sizeof(strategies) / sizeof(strategies[0]) - 1;
+    for (i = 0; i < last; i++) {
+        if (strategies[i].type == type) break;
+    }
+    return strategies + i;
+}
+
+/**
+ * @brief Select the card again after failed auth or read halted it. The
+ * known target is re-activated first, a full poll is the fallback.
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR if card is lost
+ */
+int reselectCard(PN532 *pReader, PN532_Target *target) {
+    if (PN532_SelectTarget(pReader, target->tg) == PN532_ERROR_NONE) {
+        return PN532_STATUS_OK;
+    }
+    gWasteCnt++;
+    if (PN532_ReadPassiveTargetInfo(pReader, target, PN532_MIFARE_ISO14443A, 1000) == PN532_STATUS_ERROR) {
+        log_wrn ("Card lost");
+        return PN532_STATUS_ERROR;
+    }
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Authenticate sector of the block trying every key, starting from
+ * the key which fit last time.
+ *
+ * @param key_type MIFARE_CMD_AUTH_A or MIFARE_CMD_AUTH_B
+ * @return PN532_ERROR_NONE, -2 if no key fits, PN532_STATUS_ERROR if card is lost
+ */
+int authBlock(PN532 *pReader, PN532_Target *target, uint16_t block_number, uint8_t key_type) {
+    uint32_t pn532_error;
+    int ik, ix, *pKeyIx = gKeyIx + (key_type == MIFARE_CMD_AUTH_B);
+
+    for (ik = 0; ik < gKeyCount; ik++) {
+        ix = (*pKeyIx + ik) % gKeyCount;
+        log_dbg ("Auth block %hu by key %c %s...", block_number, key_type == MIFARE_CMD_AUTH_B ? 'B' : 'A', dumpHexData(keys[ix].key, 6, 0));
+        gAuthCnt++;
+        pn532_error = PN532_MifareClassicAuthenticateBlock(pReader, target->uid, target->uid_length,
+                block_number, key_type, keys[ix].key);
+        if (pn532_error == PN532_ERROR_NONE) {
+            *pKeyIx = ix;
+            return PN532_ERROR_NONE;
+        }
+        log_wrn ("Auth block %hu error 0x%X", block_number, pn532_error);
+        gWasteCnt += 2;
+        if (reselectCard(pReader, target) == PN532_STATUS_ERROR) {
+            return PN532_STATUS_ERROR;
+        }
+    }
+    return -2;
+}
+
+/**
+ * @brief Pass a card event to every configured sink
+ */
+void publishEvent(CardEvent *event) {
+    event->sequence = gEventSeq++;
+    if (gSocketPath) {
+        Server_Publish(&gServer, event);
+    }
+    if (gShmName) {
+        Ring_Publish(&gRing, event);
+    }
+    if (gJournalDir) {
+        Journal_Append(&gJournal, event);
+    }
+}
+
+/**
+ * @brief Publish an event of the target without data
+ */
+void publishTarget(uint8_t type, PN532_Target *target) {
+    CardEvent event;
+
+    Event_Init(&event, type, target);
+    publishEvent(&event);
+}
+
+/**
+ * @brief Append a new or changed row to the EVENT_CHANGES data
+ */
+void addChange(uint16_t number, int status, uint8_t *data, uint8_t *previous, uint8_t length) {
+    uint8_t *p = gChanges + gChangesLength;
+    uint16_t size = EVENT_CHANGE_HEADER + length * (status == STORE_CHANGED ? 2 : 1);
+
+    if (gChangesFull || gChangesLength + size > EVENT_DATA_MAX) {
+        gChangesFull = 1;
+        return;
+    }
+    *p++ = number & 0xFF;
+    *p++ = number >> 8;
+    *p++ = status;
+    *p++ = length;
+    memcpy(p, data, length);
+    if (status == STORE_CHANGED) {
+        memcpy(p + length, previous, length);
+    }
+    gChangesLength += size;
+}
+
+/**
+ * @brief Show a block or page. With a dump store only rows which differ from
+ * the previous read of the card are shown, together with their previous value.
+ *
+ * @param tag BLK or PAG
+ */
+void showBlock(const char *tag, uint16_t number, uint8_t *data, uint8_t length) {
+    uint8_t previous[STORE_ROW_LENGTH];
+    int r = gStore.map ? Store_Update(&gStore, number, data, length, previous) : STORE_NEW;
+
+    if ((number + 1) * length <= EVENT_DATA_MAX) {
+        memcpy(gDump + number * length, data, length);
+        if (gDumpLength < (number + 1) * length) gDumpLength = (number + 1) * length;
+    }
+    if (r == STORE_SAME) return;
+    if (gStore.map) {
+        addChange(number, r, data, previous, length);
+    }
+    log_all ("\033[90m%s \033[32m%02d:\033[0m %s", tag, number, dumpHexData(data, length, 1));
+    if (r == STORE_CHANGED) {
+        log_all ("\033[90m    was:\033[0m %s", dumpHexData(previous, length, 1));
+    }
+}
+
+int readBlock(PN532 *pReader, uint16_t block_number, uint8_t *buff, int show) {
     uint32_t pn532_error = PN532_ERROR_NONE;
-    uint8_t buff[255];
 
-    log_dbg ("Auth block %hhu by key %s...", block_number, dumpHexData(key->key, 6, 0));
-    pn532_error = PN532_MifareClassicAuthenticateBlock(pReader, uid, uid_len,
-            block_number, MIFARE_CMD_AUTH_A, key->key);
+    gReadCnt++;
+    pn532_error = PN532_MifareClassicReadBlock(pReader, buff, block_number);
     if (pn532_error != PN532_ERROR_NONE) {
-        log_wrn ("Auth block %hhu error 0x%X", block_number, pn532_error);
-        return -2;
+        log_wrn ("Read block %hu error 0x%X", block_number, pn532_error);
+        return pn532_error;
     }
 
-    pn532_error = PN532_MifareClassicReadBlock(pReader, buff, block_number);
+    if (show) {
+        showBlock ("BLK", block_number, buff, MIFARE_BLOCK_LENGTH);
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+ * @brief Read wanted blocks of MIFARE Classic sector. Access bits of the
+ * trailer (cached per UID) choose key A or B for each block, blocks which
+ * are never readable are skipped.
+ *
+ * @param entry cached access conditions of the card
+ * @return PN532_ERROR_NONE, PN532_STATUS_ERROR if card is lost
+ */
+int readSector(PN532 *pReader, PN532_Target *target, uint8_t sector, Mifare_AccessEntry *entry) {
+    uint16_t block_number, first = Mifare_SectorFirstBlock(sector);
+    uint16_t trailer = Mifare_SectorTrailer(sector);
+    uint8_t buff[MIFARE_BLOCK_LENGTH], access, need, failed, authed = 0, noKey = 0, shown = 0;
+    int r;
+
+    for (block_number = first; block_number <= trailer; block_number++) {
+        if (wantBlock(block_number)) break;
+    }
+    if (block_number > trailer) return PN532_ERROR_NONE;
+
+    if (!(entry->sectors[sector] & MIFARE_ACCESS_KNOWN)) {
+        // Access bits of the trailer are always readable with key A
+        r = authBlock(pReader, target, trailer, MIFARE_CMD_AUTH_A);
+        if (r == PN532_STATUS_ERROR) return r;
+        if (r == PN532_ERROR_NONE) {
+            authed = MIFARE_CMD_AUTH_A;
+            shown = wantBlock(trailer);
+            if (readBlock(pReader, trailer, buff, shown) != PN532_ERROR_NONE) {
+                shown = 0;
+                gWasteCnt += 2;
+                authed = 0;
+                if (reselectCard(pReader, target) == PN532_STATUS_ERROR) return PN532_STATUS_ERROR;
+            } else if (Mifare_DecodeAccessBits(buff, entry->sectors + sector) != PN532_STATUS_OK) {
+                log_wrn ("Sector %hhu has invalid access bits", sector);
+            }
+        } else {
+            noKey |= MIFARE_ACCESS_KEY_A;
+        }
+    }
+
+    for (; block_number <= trailer; block_number++) {
+        if (!wantBlock(block_number)) continue;
+        if (block_number == trailer && shown) {
+            continue;   // shown while access bits were read
+        }
+        // Unknown access conditions: try key A, then key B
+        access = MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B;
+        if (entry->sectors[sector] & MIFARE_ACCESS_KNOWN) {
+            access = Mifare_BlockAccess(entry->sectors[sector], block_number);
+        }
+        access &= ~noKey;
+        if (!access) {
+            log_dbg ("Skip block %hu, not readable with given keys", block_number);
+            gSkipCnt++;
+            continue;
+        }
+        while (access) {
+            need = (access & MIFARE_ACCESS_KEY_A) ? MIFARE_CMD_AUTH_A : MIFARE_CMD_AUTH_B;
+            if (authed == need) break;
+            r = authBlock(pReader, target, block_number, need);
+            if (r == PN532_STATUS_ERROR) return r;
+            if (r == PN532_ERROR_NONE) {
+                authed = need;
+                break;
+            }
+            // No key of this type fits, try the other one
+            authed = 0;
+            failed = need == MIFARE_CMD_AUTH_A ? MIFARE_ACCESS_KEY_A : MIFARE_ACCESS_KEY_B;
+            noKey |= failed;
+            access &= ~failed;
+        }
+        if (!access) continue;
+        if (readBlock(pReader, block_number, buff, 1) != PN532_ERROR_NONE) {
+            // Failed read halts the card, cached access bits may be stale
+            gWasteCnt += 2;
+            authed = 0;
+            entry->sectors[sector] = 0;
+            if (reselectCard(pReader, target) == PN532_STATUS_ERROR) {
+                return PN532_STATUS_ERROR;
+            }
+        }
+    }
+    if (noKey == (MIFARE_ACCESS_KEY_A | MIFARE_ACCESS_KEY_B)) {
+        log_wrn ("No key fits sector %hhu", sector);
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+ * @brief Read Ultralight/NTAG pages. One READ returns 4 pages, only wanted ones are shown.
+ *
+ * @return PN532 error code (NAK past the end of tag memory)
+ */
+int readPages(PN532 *pReader, uint16_t page) {
+    uint32_t pn532_error;
+    uint8_t buff[MIFARE_BLOCK_LENGTH];
+    gReadCnt++;
+    pn532_error = PN532_MifareClassicReadBlock(pReader, buff, page);
     if (pn532_error != PN532_ERROR_NONE) {
-        log_wrn ("Read block %hhu error 0x%X", block_number, pn532_error);
+        log_dbg ("Read page %hu error 0x%X", page, pn532_error);
         return pn532_error;
     }
+    for (int i = 0; i < 4; i++) {
+        if (!wantBlock(page + i)) continue;
+        showBlock ("PAG", page + i, buff + i * NTAG2XX_BLOCK_LENGTH, NTAG2XX_BLOCK_LENGTH);
+    }
+    return PN532_ERROR_NONE;
+}
 
-    log_all ("\033[90mBLK \033[32m%02d:\033[0m %s", block_number, dumpHexData(buff, 16, 1));
+/**
+ * @brief Send the APDU batch of -Q to an ISO14443-4 card, the batch stops at
+ * the first error status word
+ */
+void sendApdus(PN532 *pReader, PN532_Target *target) {
+    CardEvent event;
+    uint16_t length = 0;
+    int i, r;
+
+    r = PN532_ApduBatch(pReader, target->tg, gApdus, gApduCnt);
+    for (i = 0; i < gApduCnt && gApdus[i].sw; i++) {
+        log_all ("\033[90mAPDU \033[32m%02d:\033[0m SW %04X %s", i, gApdus[i].sw,
+                dumpHexData(gApdus[i].response, gApdus[i].response_length, 1));
+        length += gApdus[i].response_length;
+    }
+    if (r != PN532_ERROR_NONE && r != PN532_ERROR_APDU_STATUS) {
+        log_wrn ("APDU %d error 0x%X", i, r);
+    }
+    Event_Init(&event, EVENT_DATA, target);
+    event.data = pReader->apdu;
+    event.data_length = length;
+    publishEvent(&event);
+}
+
+/**
+ * @brief Read the NDEF message of Ultralight/NTAG and show its records. Pages
+ * are read only as far as the message goes.
+ */
+void readNdef(PN532 *pReader, PN532_Target *target) {
+    NdefReader *ndef = &gNdefReader;
+    NdefRecord record;
+    CardEvent event;
+    uint16_t offset = 0;
+    int r;
+
+    // The tag kind is unknown, FAST_READ support is probed again if worth it
+    ndef->fast_read = NDEF_FAST_READ_UNKNOWN;
+    r = Ndef_Read(ndef, pReader, target);
+    if (r != PN532_ERROR_NONE) {
+        log_wrn ("No NDEF message (error 0x%X) after %hu reads", r, ndef->reads);
+        return;
+    }
+    log_inf ("NDEF message of %hu bytes in %hu reads (%hu of %hu data bytes), version %hhu.%hhu%s",
+            ndef->message_length, ndef->reads, ndef->loaded, ndef->size, ndef->version >> 4, ndef->version & 0x0F,
+            ndef->fast_read == NDEF_FAST_READ_YES ? ", FAST_READ" : "");
+    while ((r = Ndef_NextRecord(ndef->message, ndef->message_length, &offset, &record)) == PN532_ERROR_NONE) {
+        if (Ndef_IsUri(&record)) {
+            log_all ("\033[90mURI:\033[0m %s%.*s", Ndef_UriPrefix(record.payload[0]),
+                    (int)record.payload_length - 1, (const char*)record.payload + 1);
+        } else {
+            log_all ("\033[90mTNF %hhu %.*s:\033[0m %s", record.tnf, record.type_length, (const char*)record.type,
+                    dumpHexData((uint8_t*)record.payload, record.payload_length, 1));
+        }
+    }
+    if (r == NDEF_ERROR_FORMAT) {
+        log_wrn ("Malformed NDEF record at byte %hu", offset);
+    }
+    Event_Init(&event, EVENT_DATA, target);
+    event.data = ndef->message;
+    event.data_length = ndef->message_length;
+    publishEvent(&event);
+}
+
+/**
+ * @brief Read wanted FeliCa blocks of the read-only service, consecutive
+ * blocks go in one Read Without Encryption
+ *
+ * @return PN532 error code
+ */
+int readFelica(PN532 *pReader, PN532_Target *target, uint16_t blocks) {
+    uint8_t buff[FELICA_READ_BLOCKS * PN532_FELICA_BLOCK_LENGTH], count;
+    uint16_t block_number = 0;
+    uint32_t pn532_error;
+
+    while (block_number < blocks) {
+        if (!wantBlock(block_number)) {
+            block_number++;
+            continue;
+        }
+        for (count = 1; count < FELICA_READ_BLOCKS && block_number + count < blocks
+                && wantBlock(block_number + count); count++);
+        gReadCnt++;
+        pn532_error = PN532_FelicaReadBlocks(pReader, target, PN532_FELICA_SERVICE_RO, block_number, count, buff);
+        if (pn532_error != PN532_ERROR_NONE) {
+            log_wrn ("Read FeliCa block %hu error 0x%X", block_number, pn532_error);
+            return pn532_error;
+        }
+        for (int i = 0; i < count; i++) {
+            showBlock ("FEL", block_number + i, buff + i * PN532_FELICA_BLOCK_LENGTH, PN532_FELICA_BLOCK_LENGTH);
+        }
+        block_number += count;
+    }
     return PN532_ERROR_NONE;
 }
 
+/**
+ * @brief Read requested blocks with the strategy of detected card type.
+ * MIFARE Classic is read sector by sector with one auth per sector.
+ */
+void readCard(PN532 *pReader, PN532_Target *target) {
+    const Strategy *strategy = findStrategy(target->type);
+    CardEvent event;
+    Mifare_AccessEntry *entry;
+    uint16_t blocks, page;
+    uint8_t sector, sectors;
+
+    if (gApduCnt && ((target->sak & PN532_SAK_ISO14443_4) || target->type == PN532_CARD_ISO14443B)) {
+        sendApdus(pReader, target);
+        return;
+    }
+    if (gNdef && strategy->method == READ_ULTRALIGHT) {
+        readNdef(pReader, target);
+        return;
+    }
+    if (strategy->method == READ_UID_ONLY) {
+        log_inf ("No block reads for %s", PN532_CardTypeName(target->type));
+        return;
+    }
+    gAuthCnt = 0;
+    gReadCnt = 0;
+    gWasteCnt = 0;
+    gSkipCnt = 0;
+    blocks = strategy->method == READ_CLASSIC ? Mifare_BlockCount(target->type) : strategy->blocks;
+    if (gBlocksCnt) {
+        log_inf ("Reading blocks [%s] of %hu...", gBlocksName, blocks);
+    } else {
+        log_inf ("Reading blocks [%hu - %hu]...", gFirstBlock, gLastBlock < blocks ? gLastBlock : blocks - 1);
+    }
+    memset(gDump, 0, sizeof(gDump));
+    gDumpLength = 0;
+    gChangesLength = 0;
+    gChangesFull = 0;
+    if (gStoreDir) {
+        Store_Open(&gStore, gStoreDir, target->uid, target->uid_length);
+    }
+    if (strategy->method == READ_FELICA) {
+        readFelica (pReader, target, blocks);
+    } else if (strategy->method == READ_ULTRALIGHT) {
+        for (page = 0; page < blocks; page += 4) {
+            if (!(wantBlock(page) || wantBlock(page + 1) || wantBlock(page + 2) || wantBlock(page + 3))) continue;
+            if (readPages (pReader, page) != PN532_ERROR_NONE) break;
+        }
+    } else {
+        entry = Mifare_AccessLookup(&gAccessCache, target->uid, target->uid_length);
+        sectors = Mifare_SectorCount(target->type);
+        for (sector = 0; sector < sectors; sector++) {
+            if (readSector (pReader, target, sector, entry) == PN532_STATUS_ERROR) break;
+        }
+    }
+    log_inf ("Card read with %d auths and %d reads, %d round-trips wasted, %d blocks skipped",
+            gAuthCnt, gReadCnt, gWasteCnt, gSkipCnt);
+    Event_Init(&event, EVENT_DATA, target);
+    event.data = gDump;
+    event.data_length = gDumpLength;
+    if (gStore.map) {
+        log_inf ("Dump diff: %u changed, %u new, %u unchanged", gStore.changed, gStore.added, gStore.unchanged);
+        Store_Close(&gStore);
+        // Subscribers get what changed, unless it is bigger than the card image
+        if (!gChangesFull) {
+            event.type = EVENT_CHANGES;
+            event.data = gChanges;
+            event.data_length = gChangesLength;
+        }
+    }
+    publishEvent(&event);
+}
+
+/**
+ * @brief Switch tap feedback pins (LED, buzzer) with one WRITEGPIO, pins
+ * already in the wanted state cost no command at all
+ */
+void tapFeedback(PN532 *pReader, int on) {
+    int i;
+
+    if (!gTapPinCnt) return;
+    for (i = 0; i < gTapPinCnt; i++) {
+        PN532_GpioSet(pReader, gTapPins[i], on);
+    }
+    if (PN532_GpioFlush(pReader) != PN532_STATUS_OK) {
+        log_wrn ("Tap feedback GPIO write failed");
+    }
+}
+
+/**
+ * @brief Decide access for the UID before any PN532 round-trip, then emit
+ * the arrival and the decision, no blocks are read
+ */
+void checkAccess(PN532_Target *target) {
+    struct timespec beg, end;
+    CardEvent event;
+    uint8_t decision;
+    int allow;
+
+    clock_gettime(CLOCK_MONOTONIC, &beg);
+    allow = Allowlist_Check(&gAllowlist, target->uid, target->uid_length);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    decision = allow;
+    publishTarget(EVENT_ARRIVED, target);
+    Event_Init(&event, EVENT_ACCESS, target);
+    event.data = &decision;
+    event.data_length = 1;
+    publishEvent(&event);
+    log_all ("Access %s: \033[96m%s\033[0m", allow == ALLOWLIST_ALLOW ? "\033[32mgranted\033[0m" : "\033[31mdenied\033[0m",
+            dumpHexData(target->uid, target->uid_length, 0));
+    log_dbg ("Decision in %ld ns, %u lookups, %u denied by Bloom filter",
+            (end.tv_sec - beg.tv_sec) * 1000000000L + end.tv_nsec - beg.tv_nsec,
+            gAllowlist.lookups, gAllowlist.prefiltered);
+}
+
+/**
+ * @brief Write the provisioning image to the card and verify it. The next
+ * card is written as soon as it arrives after this one is removed.
+ */
+void provisionCard(PN532 *pReader, PN532_Target *target) {
+    struct timespec beg, end;
+    int r;
+
+    log_all ("Writing card \033[96m%s\033[0m (%s)...", dumpHexData(target->uid, target->uid_length, 0),
+            PN532_CardTypeName(target->type));
+    clock_gettime(CLOCK_MONOTONIC, &beg);
+    r = Provision_Card(&gProvision, pReader, target);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (r == PN532_ERROR_NONE) {
+        log_all ("\033[32mCard written and verified\033[0m in %ld ms, remove it for the next one",
+                (end.tv_sec - beg.tv_sec) * 1000L + (end.tv_nsec - beg.tv_nsec) / 1000000L);
+    } else {
+        log_err ("Card not written (error %d), remove it and try again", r);
+    }
+    log_inf ("%u auths, %u writes, %u verification reads, %u round-trips wasted; %u cards written, %u failed",
+            gProvision.auths, gProvision.writes, gProvision.reads, gProvision.wasted,
+            gProvision.cards, gProvision.failed);
+}
+
+/**
+ * @brief Apply the RFConfiguration preset chosen by -P. With a limited
+ * passive activation retry count an empty poll returns within milliseconds,
+ * the scan loop then pauses between polls instead of blocking in the PN532.
+ *
+ * @param pReader PN532 reader
+ */
+void setupRF(PN532 *pReader) {
+    const PN532_RFPreset *preset;
+    uint8_t ix;
+
+    if (gRFPreset == NULL) return;
+    preset = PN532_FindRFPreset(gRFPreset);
+    if (preset == NULL) {
+        log_wrn ("Unknown RF preset %s, known presets:", gRFPreset);
+        for (ix = 0; (preset = PN532_RFPresetAt(ix)) != NULL; ix++) {
+            log_wrn ("  %s", preset->name);
+        }
+        return;
+    }
+    if (PN532_ApplyRFPreset(pReader, preset) != PN532_ERROR_NONE) {
+        log_err ("Failed to apply RF preset %s", preset->name);
+        return;
+    }
+    if (preset->max_retries_passive != PN532_RF_RETRIES_INFINITE) {
+        pollIdleUs = POLL_IDLE_US;
+    }
+    log_inf ("RF preset %s applied", preset->name);
+}
+
+/**
+ * @brief Look up the analog tuning profile chosen by -T
+ */
+void setupTuning(void) {
+    const PN532_AnalogProfile *profile;
+    uint8_t ix;
+
+    if (gTuningName == NULL) return;
+    gTuning = PN532_FindAnalogProfile(gTuningName);
+    if (gTuning == NULL) {
+        log_wrn ("Unknown analog tuning %s, known profiles:", gTuningName);
+        for (ix = 0; (profile = PN532_AnalogProfileAt(ix)) != NULL; ix++) {
+            log_wrn ("  %s", profile->name);
+        }
+    }
+}
+
+/**
+ * @brief Apply the analog tuning profile, the PN532 reloads its own analog
+ * settings on every target activation
+ */
+void applyTuning(PN532 *pReader) {
+    if (gTuning == NULL) return;
+    if (PN532_ApplyAnalogProfile(pReader, gTuning) != PN532_STATUS_OK) {
+        log_wrn ("Failed to apply analog tuning %s", gTuning->name);
+        return;
+    }
+    log_dbg ("Analog tuning %s applied, %u register writes skipped so far", gTuning->name, pReader->registers_skipped);
+}
+
+/**
+ * @brief Log the replay benchmark: host time spent on the recorded session
+ */
+void reportReplay(struct timespec *start) {
+    PN532_ReplayStats stats;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    PN532_Replay_Stats(&stats);
+    log_all ("Replay done in %.1f ms (virtual %.1f ms): %u records, %u mismatched writes, %u underruns",
+            (end.tv_sec - start->tv_sec) * 1000.0 + (end.tv_nsec - start->tv_nsec) / 1000000.0,
+            stats.virtual_us / 1000.0, stats.records, stats.mismatches, stats.underruns);
+}
+
+/**
+ * @brief SIGINT/SIGTERM handler, the read loop ends after the current poll
+ */
+void stopReading(int sig) {
+    (void) sig;
+    gRunning = 0;
+}
+
+/**
+ * @brief Flush and close the event sinks and the traffic recording, so
+ * buffered journal events are committed and no socket or shm is left behind
+ */
+void closeReader(PN532 *pReader) {
+    if (gJournalDir) {
+        Journal_Close(&gJournal);
+    }
+    if (gSocketPath) {
+        Server_Close(&gServer);
+    }
+    if (gShmName) {
+        Ring_Close(&gRing);
+    }
+    if (gRecordFile && !gReplayFile) {
+        PN532_Record_Stop(pReader);
+    }
+}
+
 int main(int argc, char** argv) {
-    uint8_t buff[255], doRead = 1, block_number;
-    uint8_t uid[MIFARE_UID_MAX_LENGTH];
-    int32_t uid_len = 0, ix, ik, r;
+    uint8_t buff[255];
+    int ret = 0;
+    PN532_Target *target;
+    Session session;
+    struct timespec replayStart;
     PN532 pn532;
+    memset(&pn532, 0, sizeof(pn532));
     memset(keys, 0, KEYS_SZ*sizeof(Key));
 
     parseArguments (argc, argv);
@@ -337,58 +1298,161 @@ int main(int argc, char** argv) {
 
     log_all ("App %s version %s log level %s with keys: %s", PROJECT, VERSION, logLevelHeaders[gLogLevel], dumpKeys());
 
-    PN532_SPI_Init(&pn532);
-    // PN532_I2C_Init(&pn532);
-    //PN532_UART_Init(&pn532);
+    if (gAllowlistSource) {
+        if (!gAllowlistFile) {
+            log_err ("Allowlist index file (-A) is required to build from %s", gAllowlistSource);
+            return -1;
+        }
+        return Allowlist_Build(gAllowlistSource, gAllowlistFile, true) == PN532_STATUS_OK ? 0 : -1;
+    }
+    if (gAllowlistFile && Allowlist_Open(&gAllowlist, gAllowlistFile) != PN532_STATUS_OK) {
+        log_wrn ("Every card is denied until %s is valid", gAllowlistFile);
+    }
+
+    if (gProvisionFile && Provision_Load(&gProvision, gProvisionFile, gWriteTrailers ? PROVISION_TRAILERS : 0,
+            (const uint8_t*)keys, gKeyCount) != PN532_STATUS_OK) {
+        return -1;
+    }
+
+    if (gSocketPath && Server_Open(&gServer, gSocketPath) != PN532_STATUS_OK) {
+        return -1;
+    }
+
+    if (gJournalDir && Journal_Open(&gJournal, gJournalDir) != PN532_STATUS_OK) {
+        ret = -1;
+        goto done;
+    }
+    if (gShmName && Ring_Open(&gRing, gShmName) != PN532_STATUS_OK) {
+        ret = -1;
+        goto done;
+    }
+
+    pn532.full_init = gFullInit;
+    if (gReplayFile) {
+        pn532.log = PN532_Log;
+        pn532.trace = PN532_Trace;
+        if (PN532_Replay_Init(&pn532, gReplayFile, gReplayFast ? PN532_REPLAY_FAST : PN532_REPLAY_REALTIME) != PN532_STATUS_OK) {
+            log_err ("Can't replay %s", gReplayFile);
+            ret = -1;
+            goto done;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &replayStart);
+        log_inf ("Replaying %s %s", gReplayFile, gReplayFast ? "as fast as possible" : "at recorded speed");
+    } else if (strcmp(gTransport, "spidev") == 0) {
+        PN532_SPIDEV_Init(&pn532);
+    } else if (strcmp(gTransport, "i2c") == 0) {
+        PN532_I2C_Init(&pn532);
+    } else if (strcmp(gTransport, "uart") == 0) {
+        PN532_UART_Init(&pn532);
+    } else {
+        PN532_SPI_Init(&pn532);
+    }
+    log_inf ("PN532 started in %u ms (%s)", pn532.startup_ms,
+            pn532.fast_started ? "fast start" : "reset and wakeup");
+    if (gRecordFile && !gReplayFile) {
+        if (PN532_Record_Start(&pn532, gRecordFile) != PN532_STATUS_OK) {
+            log_err ("Can't record to %s", gRecordFile);
+            ret = -1;
+            goto done;
+        }
+        log_inf ("Recording PN532 traffic to %s", gRecordFile);
+    }
     if (PN532_GetFirmwareVersion(&pn532, buff) == PN532_STATUS_OK) {
         log_inf ("Found PN532 with firmware version: %hhu.%hhu", buff[1], buff[2]);
     } else {
         log_err ("Didn't find PN53x chip");
-        return -1;
+        ret = -1;
+        goto done;
+    }
+    setupClock(&pn532);
+    if (gBench > 0) {
+        benchPolling(&pn532, gBench);
+        goto done;
     }
     PN532_SamConfiguration(&pn532);
-    while (doRead) {
-        log_all ("Scan your RFID/NFC card...");
-        memset (uid, 0, MIFARE_UID_MAX_LENGTH);
-        while (doRead) {
-            // Check if a card is available to read
-            uid_len = PN532_ReadPassiveTarget(&pn532, uid, PN532_MIFARE_ISO14443A, 1000);
-            if (uid_len != PN532_STATUS_ERROR) {
-                log_all ("Found card with UID: \033[96m%s\033[0m", dumpHexData(uid, uid_len, 0));
-                break;
-            }
+    setupRF(&pn532);
+    setupTuning();
+    Session_Init(&session, gHoldoverMs, gDebounceMs);
+    session.poll_types = gPollTypes;
+    Idle_Init(&gIdle, gIdleMs, gRFPreset ? PN532_FindRFPreset(gRFPreset) : NULL);
+    Idle_Reset(&gIdle, &pn532);
+    signal(SIGINT, stopReading);
+    signal(SIGTERM, stopReading);
+    log_all ("Scan your RFID/NFC card...");
+    while (gRunning) {
+        if (gSocketPath) {
+            Server_Poll(&gServer);
+        }
+        if (gJournalDir) {
+            Journal_Poll(&gJournal);
         }
-        if (!doRead) break;
-        if (gBlocks) {
-            log_inf ("Reading blocks [%s]...", gBlocksName);
-            for (ix = 0; ix < gBlocksCnt; ix ++) {
-                block_number = gBlocks[ix];
-                for (ik = 0; ik < gKeyCount; ik++) {
-                    r = readBlock (&pn532, uid, uid_len, keys + ix, block_number);
-                    if (r == PN532_ERROR_NONE) continue;
-                    if (r == -2) {
-                        uid_len = PN532_ReadPassiveTarget(&pn532, uid, PN532_MIFARE_ISO14443A, 1000);
-                        if (uid_len != PN532_STATUS_ERROR) {
-                            continue;
-                        }
-                        break;
-                    }
+        switch (Session_Poll(&session, &pn532)) {
+            case SESSION_EVENT_ARRIVED:
+                target = &session.target;
+                if (gAllowlistFile) {
+                    checkAccess (target);
+                }
+                Idle_CardFound (&gIdle, &pn532);
+                applyTuning (&pn532);
+                // Tap feedback ends the tap sequence, after the decision or the read
+                if (gAllowlistFile) {
+                    tapFeedback (&pn532, 1);
                     break;
                 }
-            }
-        } else {
-            log_inf ("Reading blocks [%hhu - %hhu]...", gFirstBlock, gLastBlock);
-            for (block_number = gFirstBlock; block_number <= gLastBlock; block_number++) {
-                for (ik = 0; ik < gKeyCount; ik++) {
-                    r = readBlock (&pn532, uid, uid_len, keys + ix, block_number);
-                    if (r == -2) continue;
-                    if (r == PN532_ERROR_NONE) continue;
+                publishTarget (EVENT_ARRIVED, target);
+                if (gProvisionFile) {
+                    provisionCard (&pn532, target);
+                    tapFeedback (&pn532, 1);
                     break;
                 }
-            }
+                log_all ("Found card with UID: \033[96m%s\033[0m", dumpHexData(target->uid, target->uid_length, 0));
+                log_inf ("Card type %s, ATQA %04X, SAK %02X", PN532_CardTypeName(target->type), target->atqa, target->sak);
+                if (target->ats_length) {
+                    log_dbg ("ATS: %s", dumpHexData(target->ats, target->ats_length, 0));
+                }
+                readCard (&pn532, target);
+                tapFeedback (&pn532, 1);
+                log_dbg ("Link recovery: nack %u, resend %u, wakeup %u, failed %u",
+                        pn532.recovery.nacks, pn532.recovery.resends,
+                        pn532.recovery.wakeups, pn532.recovery.failures);
+                break;
+
+            case SESSION_EVENT_CONTINUED:
+                Idle_CardFound (&gIdle, &pn532);
+                tapFeedback (&pn532, 1);
+                publishTarget (EVENT_CONTINUED, &session.target);
+                log_inf ("Same card tapped again: \033[96m%s\033[0m", dumpHexData(session.target.uid, session.target.uid_length, 0));
+                break;
+
+            case SESSION_EVENT_REMOVED:
+                tapFeedback (&pn532, 0);
+                publishTarget (EVENT_REMOVED, &session.target);
+                Idle_Reset (&gIdle, &pn532);
+                log_all ("Card removed: \033[96m%s\033[0m", dumpHexData(session.target.uid, session.target.uid_length, 0));
+                log_all ("Scan your RFID/NFC card...");
+                break;
+
+            default:
+                // Pauses go through the transport clock, a fast replay skips them
+                if (session.state != SESSION_IDLE) {
+                    pn532.delay(SESSION_CHECK_MS);
+                } else if (Idle_Sleep (&gIdle, &pn532)) {
+                    // slept a power down slice, poll right after the resume
+                } else if (pollIdleUs) {
+                    pn532.delay(pollIdleUs / 1000);
+                }
+                break;
         }
-        sleep(1);
+        if (gReplayFile && PN532_Replay_Done()) {
+            gRunning = 0;
+        }
+    }
+    // Replay end and stop signals share the shutdown, a replayed journal is committed like the recorded one
+    if (gReplayFile) {
+        reportReplay(&replayStart);
     }
+done:
+    closeReader(&pn532);
 
-    return 0;
+    return ret;
 }
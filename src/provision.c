@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/pn532.h"
+#include "lib/mifare.h"
+
+#include "main.h"
+#include "provision.h"
+
+/**
+ * @brief Load the dump image
+ *
+ * @param flags PROVISION_*
+ * @param keys tried to authenticate every sector, key A first, then key B
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Provision_Load (Provision *provision, const char *path, uint8_t flags, const uint8_t *keys, uint8_t key_count) {
+    FILE *f;
+    size_t length;
+
+    memset(provision, 0, sizeof(Provision));
+    f = fopen(path, "rb");
+    if (!f) {
+        log_err ("Can't open image %s", path);
+        return PN532_STATUS_ERROR;
+    }
+    length = fread(provision->image, 1, sizeof(provision->image), f);
+    if (fgetc(f) != EOF) {
+        log_err ("Image %s is larger than %d bytes", path, PROVISION_IMAGE_MAX);
+        length = 0;
+    }
+    fclose(f);
+    if (length == 0 || length % NTAG2XX_BLOCK_LENGTH) {
+        log_err ("Image %s is not a dump of whole blocks or pages", path);
+        return PN532_STATUS_ERROR;
+    }
+    provision->length = length;
+    provision->flags = flags;
+    provision->keys = keys;
+    provision->key_count = key_count;
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Activate the card again after an error halted it
+ */
+static int reselect (Provision *provision, PN532 *pReader, PN532_Target *target) {
+    provision->wasted++;
+    if (PN532_SelectTarget(pReader, target->tg) == PN532_ERROR_NONE) {
+        return PN532_STATUS_OK;
+    }
+    provision->wasted++;
+    return PN532_ReadPassiveTargetInfo(pReader, target, PN532_MIFARE_ISO14443A, 1000);
+}
+
+/**
+ * @brief Authenticate the sector by any key of the type, starting from the one which fit last time
+ *
+ * @return PN532_ERROR_NONE, PROVISION_NO_KEY or PN532_STATUS_ERROR if card is lost
+ */
+static int authSector (Provision *provision, PN532 *pReader, PN532_Target *target, uint16_t block_number, uint8_t key_type) {
+    uint8_t ik, ix;
+
+    for (ik = 0; ik < provision->key_count; ik++) {
+        ix = (provision->key_ix + ik) % provision->key_count;
+        provision->auths++;
+        if (PN532_MifareClassicAuthenticateBlock(pReader, target->uid, target->uid_length, block_number,
+                key_type, (uint8_t*)provision->keys + ix * PROVISION_KEY_LENGTH) == PN532_ERROR_NONE) {
+            provision->key_ix = ix;
+            return PN532_ERROR_NONE;
+        }
+        provision->wasted++;
+        if (reselect(provision, pReader, target) != PN532_STATUS_OK) {
+            return PN532_STATUS_ERROR;
+        }
+    }
+    return PROVISION_NO_KEY;
+}
+
+/**
+ * @brief Write blocks of one sector from the image under one auth. Data
+ * blocks are written first and read back, the trailer goes last, so a
+ * failed sector never leaves the card with changed keys.
+ *
+ * @return PN532_ERROR_NONE, PN532 error of the failed write/read or PROVISION_MISMATCH
+ */
+static int writeSector (Provision *provision, PN532 *pReader, uint8_t sector, uint16_t blocks) {
+    uint16_t block_number, first = Mifare_SectorFirstBlock(sector);
+    uint16_t trailer = Mifare_SectorTrailer(sector);
+    uint8_t buff[MIFARE_BLOCK_LENGTH];
+    int r;
+
+    for (block_number = first; block_number < trailer && block_number < blocks; block_number++) {
+        if (block_number == 0 && !(provision->flags & PROVISION_BLOCK0)) continue;
+        provision->writes++;
+        r = PN532_MifareClassicWriteBlock(pReader, provision->image + block_number * MIFARE_BLOCK_LENGTH, block_number);
+        if (r != PN532_ERROR_NONE) {
+            log_dbg ("Write block %hu error 0x%X", block_number, r);
+            return r;
+        }
+    }
+    // Reads go out only after all writes of the sector, still under the same auth
+    for (block_number = first; block_number < trailer && block_number < blocks; block_number++) {
+        if (block_number == 0 && !(provision->flags & PROVISION_BLOCK0)) continue;
+        provision->reads++;
+        r = PN532_MifareClassicReadBlock(pReader, buff, block_number);
+        if (r != PN532_ERROR_NONE) {
+            log_dbg ("Read block %hu error 0x%X", block_number, r);
+            return r;
+        }
+        if (memcmp(buff, provision->image + block_number * MIFARE_BLOCK_LENGTH, MIFARE_BLOCK_LENGTH)) {
+            log_wrn ("Block %hu differs from the image after write", block_number);
+            return PROVISION_MISMATCH;
+        }
+    }
+    if ((provision->flags & PROVISION_TRAILERS) && trailer < blocks) {
+        // Key A is never readable back, the trailer isn't verified
+        provision->writes++;
+        r = PN532_MifareClassicWriteBlock(pReader, provision->image + trailer * MIFARE_BLOCK_LENGTH, trailer);
+        if (r != PN532_ERROR_NONE) {
+            log_dbg ("Write trailer %hu error 0x%X", trailer, r);
+            return r;
+        }
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+ * @brief Write the image to MIFARE Classic in sector order, one auth per
+ * sector. Key B is tried when no key A may write the sector.
+ */
+static int provisionClassic (Provision *provision, PN532 *pReader, PN532_Target *target) {
+    uint16_t blocks = provision->length / MIFARE_BLOCK_LENGTH;
+    uint8_t sector, sectors = Mifare_SectorCount(target->type), key_type;
+    int r = PN532_ERROR_NONE;
+
+    if (blocks > Mifare_BlockCount(target->type)) {
+        log_wrn ("Image has %hu blocks, card only %hu", blocks, Mifare_BlockCount(target->type));
+        blocks = Mifare_BlockCount(target->type);
+    }
+    for (sector = 0; sector < sectors && Mifare_SectorFirstBlock(sector) < blocks; sector++) {
+        for (key_type = MIFARE_CMD_AUTH_A; key_type <= MIFARE_CMD_AUTH_B; key_type++) {
+            r = authSector(provision, pReader, target, Mifare_SectorFirstBlock(sector), key_type);
+            if (r == PN532_STATUS_ERROR) return r;
+            if (r == PROVISION_NO_KEY) continue;
+            r = writeSector(provision, pReader, sector, blocks);
+            if (r == PN532_ERROR_NONE || r == PROVISION_MISMATCH) break;
+            // Write denied with this key type halts the card
+            provision->wasted++;
+            if (reselect(provision, pReader, target) != PN532_STATUS_OK) return PN532_STATUS_ERROR;
+            r = PROVISION_NO_KEY;
+        }
+        if (r != PN532_ERROR_NONE) {
+            log_wrn ("Sector %hhu is not written", sector);
+            return r;
+        }
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+ * @brief First page past the user memory: dynamic lock bytes and the
+ * configuration, PWD and PACK pages follow it. GET_VERSION storage size
+ * gives the user bytes of Ultralight EV1/NTAG21x, tags which NAK it
+ * (Ultralight, Ultralight C) are selected again.
+ */
+static uint16_t ultralightUserEnd (Provision *provision, PN532 *pReader, PN532_Target *target) {
+    uint8_t version[NTAG2XX_VERSION_LENGTH];
+
+    provision->reads++;
+    if (PN532_Ntag2xxGetVersion(pReader, version) != PN532_ERROR_NONE) {
+        reselect(provision, pReader, target);
+        return PROVISION_UL_C_USER_END;
+    }
+    switch (version[6]) {
+        case 0x0B: return 0x10;     // Ultralight EV1 MF0UL11
+        case 0x0E: return 0x24;     // Ultralight EV1 MF0UL21
+        case 0x0F: return 0x28;     // NTAG213
+        case 0x11: return 0x82;     // NTAG215
+        case 0x13: return 0xE2;     // NTAG216
+    }
+    // Unknown tag: 2^(size / 2) user bytes at least
+    return 4 + (1 << (version[6] >> 1)) / NTAG2XX_BLOCK_LENGTH;
+}
+
+/**
+ * @brief Write the image to Ultralight/NTAG 4 pages at a time, one READ
+ * verifies the 4 pages just written. Pages past the end of the tag NAK.
+ * Lock and configuration pages are written only with PROVISION_TRAILERS
+ * and never verified, PWD and PACK read back as zeros.
+ */
+static int provisionUltralight (Provision *provision, PN532 *pReader, PN532_Target *target) {
+    uint16_t page, group, end, verify, pages = provision->length / NTAG2XX_BLOCK_LENGTH;
+    uint16_t first = (provision->flags & PROVISION_BLOCK0) ? 0 : 4;
+    uint16_t user = pages > PROVISION_UL_USER_MIN ? ultralightUserEnd(provision, pReader, target) : pages;
+    uint8_t buff[MIFARE_BLOCK_LENGTH];
+    int r;
+
+    if (!(provision->flags & PROVISION_TRAILERS) && pages > user) {
+        log_dbg ("Lock and configuration pages from %hu skipped", user);
+        pages = user;
+    }
+    for (group = first & ~3; group < pages; group += 4) {
+        end = group + 4 < pages ? group + 4 : pages;
+        for (page = group < first ? first : group; page < end; page++) {
+            provision->writes++;
+            r = PN532_Ntag2xxWriteBlock(pReader, provision->image + page * NTAG2XX_BLOCK_LENGTH, page);
+            if (r != PN532_ERROR_NONE) {
+                log_wrn ("Write page %hu error 0x%X", page, r);
+                return r;
+            }
+        }
+        page = group < first ? first : group;
+        verify = end < user ? end : user;
+        if (page >= verify) continue;
+        provision->reads++;
+        r = PN532_MifareClassicReadBlock(pReader, buff, group);
+        if (r != PN532_ERROR_NONE) {
+            log_wrn ("Read page %hu error 0x%X", group, r);
+            return r;
+        }
+        if (memcmp(buff + (page - group) * NTAG2XX_BLOCK_LENGTH, provision->image + page * NTAG2XX_BLOCK_LENGTH,
+                (verify - page) * NTAG2XX_BLOCK_LENGTH)) {
+            log_wrn ("Pages %hu-%hu differ from the image after write", page, verify - 1);
+            return PROVISION_MISMATCH;
+        }
+    }
+    return PN532_ERROR_NONE;
+}
+
+/**
+ * @brief Write and verify the image on the card
+ *
+ * @return PN532_ERROR_NONE, PN532 error code or PROVISION_* error
+ */
+int Provision_Card (Provision *provision, PN532 *pReader, PN532_Target *target) {
+    int r;
+
+    provision->auths = 0;
+    provision->writes = 0;
+    provision->reads = 0;
+    provision->wasted = 0;
+    switch (target->type) {
+        case PN532_CARD_MIFARE_MINI:
+        case PN532_CARD_MIFARE_1K:
+        case PN532_CARD_MIFARE_2K:
+        case PN532_CARD_MIFARE_4K:
+            r = provisionClassic(provision, pReader, target);
+            break;
+        case PN532_CARD_MIFARE_ULTRALIGHT:
+            r = provisionUltralight(provision, pReader, target);
+            break;
+        default:
+            r = PROVISION_UNSUPPORTED;
+            break;
+    }
+    if (r == PN532_ERROR_NONE) {
+        provision->cards++;
+    } else {
+        provision->failed++;
+    }
+    return r;
+}
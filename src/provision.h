@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+#include "lib/pn532.h"
+
+#define PROVISION_IMAGE_MAX     4096        // MIFARE Classic 4K
+#define PROVISION_KEY_LENGTH    6
+
+// Flags
+#define PROVISION_TRAILERS      0x01        // write sector trailers (keys and access bits), Ultralight/NTAG lock and config pages
+#define PROVISION_BLOCK0        0x02        // write manufacturer block 0 / pages 0-3 (magic cards only)
+
+#define PROVISION_UL_USER_MIN   0x10        // pages below are user memory on every Ultralight/NTAG
+#define PROVISION_UL_C_USER_END 0x28        // Ultralight C lock bytes, tags without GET_VERSION
+
+// Errors besides PN532 error codes
+#define PROVISION_NO_KEY        -2          // no key can write the sector
+#define PROVISION_MISMATCH      -3          // data read back differs from the image
+#define PROVISION_UNSUPPORTED   -4          // card type can't be written
+
+/**
+ * Dump image written to every card: 16-byte blocks for MIFARE Classic,
+ * 4-byte pages for Ultralight/NTAG. Blocks past the end of the image or
+ * of the card are left alone.
+ */
+typedef struct {
+    uint8_t image[PROVISION_IMAGE_MAX];
+    uint16_t length;
+    uint8_t flags;
+    const uint8_t *keys;    // key_count keys of PROVISION_KEY_LENGTH bytes
+    uint8_t key_count;
+    uint8_t key_ix;         // key which fit last time, tried first
+    uint32_t auths;         // round-trips of the last card
+    uint32_t writes;
+    uint32_t reads;
+    uint32_t wasted;        // failed auths/writes and re-selects
+    uint32_t cards;         // cards written and verified
+    uint32_t failed;
+} Provision;
+
+int Provision_Load (Provision *provision, const char *path, uint8_t flags, const uint8_t *keys, uint8_t key_count);
+int Provision_Card (Provision *provision, PN532 *pReader, PN532_Target *target);
@@ -0,0 +1,91 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "ring.h"
+
+/**
+ * @brief Create the shared memory ring, a ring left by a previous run is
+ * replaced so attached consumers can't mix records of two producers
+ *
+ * @param name POSIX shared memory name, e.g. /reader-events
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Ring_Open (Ring *ring, const char *name) {
+    void *map;
+    int fd;
+
+    ring->name = name;
+    ring->ring = NULL;
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        log_err ("Can't create shared memory %s", name);
+        return PN532_STATUS_ERROR;
+    }
+    if (ftruncate(fd, sizeof(PN532_RingHeader)) < 0) {
+        log_err ("Can't size shared memory %s", name);
+        close(fd);
+        shm_unlink(name);
+        return PN532_STATUS_ERROR;
+    }
+    map = mmap(NULL, sizeof(PN532_RingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_err ("Can't map shared memory %s", name);
+        shm_unlink(name);
+        return PN532_STATUS_ERROR;
+    }
+    ring->ring = map;
+    ring->ring->slots = PN532_RING_SLOTS;
+    ring->ring->record_size = sizeof(PN532_RingRecord);
+    ring->ring->version = PN532_RING_VERSION;
+    // Consumers check magic last
+    __atomic_store_n(&ring->ring->magic, PN532_RING_MAGIC, __ATOMIC_RELEASE);
+    log_inf ("Card events published to shared memory %s (%u slots)", name, PN532_RING_SLOTS);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Write the event into the next slot, the oldest record is overwritten
+ */
+void Ring_Publish (Ring *ring, const CardEvent *event) {
+    PN532_RingRecord *record;
+    struct timespec ts;
+    uint64_t n;
+
+    if (!ring->ring) return;
+    n = ring->ring->head;
+    record = ring->ring->records + (n & (PN532_RING_SLOTS - 1));
+    __atomic_store_n(&record->stamp, n * 2 + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    record->time_us = event->time_us;
+    record->publish_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    record->sequence = event->sequence;
+    record->type = event->type;
+    record->card_type = event->card_type;
+    record->sak = event->sak;
+    record->uid_length = event->uid_length;
+    record->atqa = event->atqa;
+    record->data_length = event->data_length > PN532_RING_DATA_MAX ? PN532_RING_DATA_MAX : event->data_length;
+    memcpy(record->uid, event->uid, PN532_RING_UID_MAX);
+    if (record->data_length) {
+        memcpy(record->data, event->data, record->data_length);
+    }
+    __atomic_store_n(&record->stamp, n * 2 + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+void Ring_Close (Ring *ring) {
+    if (!ring->ring) return;
+    munmap(ring->ring, sizeof(PN532_RingHeader));
+    ring->ring = NULL;
+    shm_unlink(ring->name);
+}
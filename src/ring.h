@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include "lib/pn532_events.h"
+#include "event.h"
+
+/**
+ * Producer side of the shared memory event ring, see lib/pn532_events.h
+ */
+typedef struct {
+    const char *name;
+    PN532_RingHeader *ring;
+} Ring;
+
+int Ring_Open (Ring *ring, const char *name);
+void Ring_Publish (Ring *ring, const CardEvent *event);
+void Ring_Close (Ring *ring);
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE     // accept4
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "server.h"
+
+static void dropClient (ServerClient *client) {
+    close(client->fd);
+    client->fd = -1;
+}
+
+/**
+ * @brief Send queued bytes until the socket would block
+ */
+static void flushClient (ServerClient *client) {
+    ssize_t sent;
+
+    while (client->head != client->tail) {
+        sent = send(client->fd, client->queue + client->head, client->tail - client->head, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+            log_inf ("Event subscriber %d gone", client->fd);
+            dropClient(client);
+            return;
+        }
+        client->head += sent;
+    }
+    client->head = client->tail = 0;
+}
+
+/**
+ * @brief Listen on a Unix-domain socket, a stale socket file is replaced
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Server_Open (Server *server, const char *path) {
+    struct sockaddr_un addr;
+    int i;
+
+    memset(server, 0, sizeof(Server));
+    for (i = 0; i < SERVER_CLIENTS_MAX; i++) {
+        server->clients[i].fd = -1;
+    }
+    server->path = path;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_err ("Socket path %s is too long", path);
+        server->fd = -1;
+        return PN532_STATUS_ERROR;
+    }
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->fd < 0) {
+        log_err ("Can't create event socket");
+        return PN532_STATUS_ERROR;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server->fd, SERVER_CLIENTS_MAX) < 0) {
+        log_err ("Can't listen on %s", path);
+        close(server->fd);
+        server->fd = -1;
+        return PN532_STATUS_ERROR;
+    }
+    log_inf ("Card events served on %s", path);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Queue the event for every subscriber and send what the sockets accept
+ */
+void Server_Publish (Server *server, const CardEvent *event) {
+    uint8_t frame[SERVER_FRAME_PREFIX + EVENT_ENCODED_MAX];
+    ServerClient *client;
+    uint16_t length;
+    int i;
+
+    if (server->fd < 0) return;
+    length = Event_Encode(event, frame + SERVER_FRAME_PREFIX);
+    frame[0] = length & 0xFF;
+    frame[1] = length >> 8;
+    length += SERVER_FRAME_PREFIX;
+    for (i = 0; i < SERVER_CLIENTS_MAX; i++) {
+        client = server->clients + i;
+        if (client->fd < 0) continue;
+        if (client->head && SERVER_QUEUE_SZ - client->tail < length) {
+            // Compact the queue before giving up on the frame
+            memmove(client->queue, client->queue + client->head, client->tail - client->head);
+            client->tail -= client->head;
+            client->head = 0;
+        }
+        if (SERVER_QUEUE_SZ - client->tail < length) {
+            if (client->dropped++ == 0) {
+                log_wrn ("Event subscriber %d is too slow, dropping events", client->fd);
+            }
+            server->dropped++;
+            continue;
+        }
+        if (client->dropped) {
+            log_inf ("Event subscriber %d caught up, %u events dropped", client->fd, client->dropped);
+            client->dropped = 0;
+        }
+        memcpy(client->queue + client->tail, frame, length);
+        client->tail += length;
+        flushClient(client);
+    }
+}
+
+/**
+ * @brief Accept new subscribers, send queued events and notice closed
+ * connections. Never blocks, call it from the read loop.
+ */
+void Server_Poll (Server *server) {
+    ServerClient *client;
+    uint8_t discard[64];
+    ssize_t got;
+    int fd, i;
+
+    if (server->fd < 0) return;
+    while ((fd = accept4(server->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        for (i = 0; i < SERVER_CLIENTS_MAX && server->clients[i].fd >= 0; i++);
+        if (i == SERVER_CLIENTS_MAX) {
+            log_wrn ("Too many event subscribers, %d refused", fd);
+            close(fd);
+            continue;
+        }
+        client = server->clients + i;
+        client->fd = fd;
+        client->head = client->tail = client->dropped = 0;
+        log_inf ("Event subscriber %d connected", fd);
+    }
+    for (i = 0; i < SERVER_CLIENTS_MAX; i++) {
+        client = server->clients + i;
+        if (client->fd < 0) continue;
+        // Subscribers don't send anything, reading only detects hang-up
+        got = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT);
+        if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            log_inf ("Event subscriber %d disconnected", client->fd);
+            dropClient(client);
+            continue;
+        }
+        flushClient(client);
+    }
+}
+
+void Server_Close (Server *server) {
+    int i;
+
+    if (server->fd < 0) return;
+    for (i = 0; i < SERVER_CLIENTS_MAX; i++) {
+        if (server->clients[i].fd >= 0) {
+            dropClient(server->clients + i);
+        }
+    }
+    close(server->fd);
+    server->fd = -1;
+    unlink(server->path);
+}
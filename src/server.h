@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include "event.h"
+
+#define SERVER_CLIENTS_MAX  16
+#define SERVER_QUEUE_SZ     65536   // bytes queued per client, whole frames only
+#define SERVER_FRAME_PREFIX 2       // little endian length of the encoded event
+
+/**
+ * Subscriber with a bounded queue of frames not yet accepted by its socket.
+ * Frames which don't fit are dropped for this subscriber only.
+ */
+typedef struct {
+    int fd;                 // -1 - free slot
+    uint32_t head;          // next byte to send
+    uint32_t tail;          // next byte to queue
+    uint32_t dropped;       // frames dropped since the last warning
+    uint8_t queue[SERVER_QUEUE_SZ];
+} ServerClient;
+
+/**
+ * Unix-domain stream socket broadcasting length-prefixed encoded card events.
+ * Every socket is non-blocking, the read loop never waits for a subscriber.
+ */
+typedef struct {
+    int fd;
+    const char *path;
+    uint32_t dropped;       // frames dropped for slow subscribers since start
+    ServerClient clients[SERVER_CLIENTS_MAX];
+} Server;
+
+int Server_Open (Server *server, const char *path);
+void Server_Publish (Server *server, const CardEvent *event);
+void Server_Poll (Server *server);
+void Server_Close (Server *server);
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <time.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "session.h"
+
+/**
+ * @brief Session time on the transport clock, so replayed sessions keep
+ * their holdover and debounce decisions
+ */
+static uint32_t sessionMs (Session *session, PN532 *pReader) {
+    struct timespec ts;
+    uint32_t us;
+
+    if (!pReader->micros) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint32_t)ts.tv_sec * 1000u + ts.tv_nsec / 1000000;
+    }
+    us = pReader->micros();
+    if (session->clock_started) {
+        session->clock_us += us - session->last_us;
+    }
+    session->clock_started = 1;
+    session->last_us = us;
+    return session->clock_us / 1000;
+}
+
+/**
+ * @brief Reset the session tracker to wait for a card
+ *
+ * @param holdover_ms missing time before a card is reported removed
+ * @param debounce_ms window after removal in which the same card is not a new arrival
+ */
+void Session_Init (Session *session, uint32_t holdover_ms, uint32_t debounce_ms) {
+    memset(session, 0, sizeof(Session));
+    session->state = SESSION_IDLE;
+    session->holdover_ms = holdover_ms;
+    session->debounce_ms = debounce_ms;
+    session->poll_types = PN532_POLL_ISO14443A;
+}
+
+/**
+ * @brief Poll for a card of the session families. Type A alone keeps the
+ * plain InListPassiveTarget, more families go in one InAutoPoll.
+ *
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR if no card was found
+ */
+static int pollTarget (Session *session, PN532 *pReader, PN532_Target *found) {
+    if (session->poll_types == PN532_POLL_ISO14443A) {
+        if (PN532_ReadPassiveTargetInfo(pReader, found, PN532_MIFARE_ISO14443A, SESSION_POLL_TIMEOUT) == PN532_STATUS_ERROR) {
+            return PN532_STATUS_ERROR;
+        }
+        session->any.kind = PN532_POLL_ISO14443A;
+        session->any.target = *found;
+        return PN532_STATUS_OK;
+    }
+    if (PN532_PollTargets(pReader, session->poll_types, &session->any, SESSION_POLL_TIMEOUT) != PN532_STATUS_OK) {
+        return PN532_STATUS_ERROR;
+    }
+    *found = session->any.target;
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Poll for a new card when idle, otherwise check presence of the
+ * selected one. Call in a loop, a present card is checked every call.
+ *
+ * @return event raised by this poll
+ */
+SessionEvent Session_Poll (Session *session, PN532 *pReader) {
+    PN532_Target found;
+    uint32_t now;
+    int same;
+
+    if (session->state == SESSION_IDLE) {
+        if (pollTarget(session, pReader, &found) == PN532_STATUS_ERROR) {
+            return SESSION_EVENT_NONE;
+        }
+        now = sessionMs(session, pReader);
+        same = session->arrivals
+            && found.uid_length == session->target.uid_length
+            && memcmp(found.uid, session->target.uid, found.uid_length) == 0;
+        session->target = found;
+        session->state = SESSION_PRESENT;
+        if (same && now - session->removed_at < session->debounce_ms) {
+            session->suppressed++;
+            log_dbg ("Same card tapped again after %u ms, session continued", now - session->removed_at);
+            return SESSION_EVENT_CONTINUED;
+        }
+        session->arrivals++;
+        return SESSION_EVENT_ARRIVED;
+    }
+
+    if (PN532_CheckPresence(pReader, &session->target) == PN532_ERROR_NONE) {
+        session->state = SESSION_PRESENT;
+        return SESSION_EVENT_NONE;
+    }
+    now = sessionMs(session, pReader);
+    if (session->state == SESSION_PRESENT) {
+        session->state = SESSION_HOLDOVER;
+        session->missing_since = now;
+    }
+    if (now - session->missing_since < session->holdover_ms) {
+        return SESSION_EVENT_NONE;
+    }
+    session->state = SESSION_IDLE;
+    session->removed_at = now;
+    return SESSION_EVENT_REMOVED;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "lib/pn532.h"
+
+#define SESSION_HOLDOVER_MS     300     // card may miss presence checks this long before it is removed
+#define SESSION_DEBOUNCE_MS     2000    // same card tapped again within this window continues the session
+#define SESSION_CHECK_MS        100     // pause between presence checks of a present card
+#define SESSION_POLL_TIMEOUT    1000    // host timeout of a poll for a new card
+
+typedef enum {
+    SESSION_IDLE,           // no card, polling for one
+    SESSION_PRESENT,        // card selected, only presence is checked
+    SESSION_HOLDOVER        // card missed a presence check, not removed yet
+} SessionState;
+
+typedef enum {
+    SESSION_EVENT_NONE,
+    SESSION_EVENT_ARRIVED,  // new card selected, target is filled
+    SESSION_EVENT_REMOVED,  // card left the field for longer than holdover
+    SESSION_EVENT_CONTINUED // same card tapped again within debounce, target is filled, not read again
+} SessionEvent;
+
+/**
+ * Card session: a card raises one arrived event when it is selected and one
+ * removed event when it is gone, a card which is lifted and tapped again
+ * within the debounce window raises continued instead of arrived, so every
+ * removed event follows an arrived or continued one.
+ */
+typedef struct {
+    SessionState state;
+    PN532_Target target;
+    uint8_t poll_types;     // PN532_POLL_* families polled for a new card
+    PN532_AnyTarget any;    // family specific data of the current card
+    uint32_t holdover_ms;
+    uint32_t debounce_ms;
+    uint32_t missing_since; // ms when the card failed its first presence check
+    uint32_t removed_at;    // ms when the last card was removed
+    uint32_t arrivals;      // arrived events raised
+    uint32_t suppressed;    // taps of the same card within debounce
+    uint64_t clock_us;      // session clock accumulated from pReader->micros
+    uint32_t last_us;
+    uint8_t clock_started;
+} Session;
+
+void Session_Init (Session *session, uint32_t holdover_ms, uint32_t debounce_ms);
+SessionEvent Session_Poll (Session *session, PN532 *pReader);
@@ -0,0 +1,102 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lib/pn532.h"
+
+#include "main.h"
+#include "store.h"
+
+/**
+ * @brief Map the last dump of the card, the file is created empty on the first read
+ *
+ * @param dir directory of dump files
+ * @return PN532_STATUS_OK or PN532_STATUS_ERROR
+ */
+int Store_Open (BlockStore *store, const char *dir, uint8_t *uid, uint8_t uid_length) {
+    char path[STORE_PATH_SZ];
+    struct stat st;
+    size_t ofs;
+    uint8_t i;
+
+    memset(store, 0, sizeof(BlockStore));
+    store->fd = -1;
+    ofs = snprintf(path, sizeof(path), "%s/", dir);
+    for (i = 0; i < uid_length && ofs + 3 < sizeof(path); i++) {
+        ofs += snprintf(path + ofs, sizeof(path) - ofs, "%02X", uid[i]);
+    }
+    snprintf(path + ofs, sizeof(path) - ofs, ".dump");
+
+    store->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (store->fd < 0 || fstat(store->fd, &st) < 0) {
+        log_wrn ("Can't open dump %s", path);
+        Store_Close(store);
+        return PN532_STATUS_ERROR;
+    }
+    if (st.st_size != sizeof(StoreFile) && ftruncate(store->fd, sizeof(StoreFile)) < 0) {
+        log_wrn ("Can't size dump %s", path);
+        Store_Close(store);
+        return PN532_STATUS_ERROR;
+    }
+    store->map = mmap(NULL, sizeof(StoreFile), PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED) {
+        store->map = NULL;
+        log_wrn ("Can't map dump %s", path);
+        Store_Close(store);
+        return PN532_STATUS_ERROR;
+    }
+    if (store->map->magic != STORE_MAGIC || store->map->version != STORE_VERSION
+            || store->map->rows != STORE_ROWS) {
+        memset(store->map, 0, sizeof(StoreFile));
+        store->map->magic = STORE_MAGIC;
+        store->map->version = STORE_VERSION;
+        store->map->rows = STORE_ROWS;
+    }
+    log_dbg ("Dump %s mapped", path);
+    return PN532_STATUS_OK;
+}
+
+/**
+ * @brief Compare a row with its previous value and store the new one
+ *
+ * @param previous filled with the previous value when the row changed
+ * @return STORE_NEW, STORE_SAME or STORE_CHANGED
+ */
+int Store_Update (BlockStore *store, uint16_t row, const uint8_t *data, uint8_t length, uint8_t *previous) {
+    uint8_t *stored, bit;
+
+    if (row >= STORE_ROWS || length > STORE_ROW_LENGTH) return STORE_NEW;
+    stored = store->map->data[row];
+    bit = 1 << (row & 7);
+    if (!(store->map->valid[row >> 3] & bit)) {
+        memcpy(stored, data, length);
+        store->map->valid[row >> 3] |= bit;
+        store->added++;
+        return STORE_NEW;
+    }
+    if (memcmp(stored, data, length) == 0) {
+        store->unchanged++;
+        return STORE_SAME;
+    }
+    memcpy(previous, stored, length);
+    memcpy(stored, data, length);
+    store->changed++;
+    return STORE_CHANGED;
+}
+
+/**
+ * @brief Unmap the dump, dirty pages are written back by the kernel
+ */
+void Store_Close (BlockStore *store) {
+    if (store->map) {
+        munmap(store->map, sizeof(StoreFile));
+        store->map = NULL;
+    }
+    if (store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+}
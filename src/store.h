@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+
+#define STORE_MAGIC         0x504D4452  // "RDMP"
+#define STORE_VERSION       1
+#define STORE_ROWS          256         // MIFARE Classic 4K blocks, Ultralight/NTAG pages
+#define STORE_ROW_LENGTH    16
+#define STORE_PATH_SZ       512
+
+#define STORE_NEW           0           // no previous value of the row
+#define STORE_SAME          1
+#define STORE_CHANGED       2
+
+/**
+ * Last dump of a card, mapped from <dir>/<uid>.dump. A row keeps one block,
+ * or one page in its first 4 bytes, valid marks rows read at least once.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rows;
+    uint8_t valid[STORE_ROWS / 8];
+    uint8_t data[STORE_ROWS][STORE_ROW_LENGTH];
+} StoreFile;
+
+typedef struct {
+    int fd;
+    StoreFile *map;
+    uint32_t added;         // rows read for the first time
+    uint32_t changed;
+    uint32_t unchanged;
+} BlockStore;
+
+int Store_Open (BlockStore *store, const char *dir, uint8_t *uid, uint8_t uid_length);
+int Store_Update (BlockStore *store, uint16_t row, const uint8_t *data, uint8_t length, uint8_t *previous);
+void Store_Close (BlockStore *store);